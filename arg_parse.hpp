@@ -30,6 +30,16 @@ struct ArgParse
     while (idx < argc)
     {
       string cmd = argv[idx];
+
+      // long arguments can be given as either "--name value" or "--name=value"
+      const char* inlineValue = nullptr;
+      size_t eq = cmd.find('=');
+      if (cmd.compare(0, 2, "--") == 0 && eq != string::npos)
+      {
+        inlineValue = argv[idx] + eq + 1;
+        cmd = cmd.substr(0, eq);
+      }
+
       // oh noes, O(n), tihi
       BaseHandler* handler = nullptr;
       for (int i = 0; i < (int)handlers.size(); ++i)
@@ -49,20 +59,21 @@ struct ArgParse
         return true;
       }
 
-      if (argc - idx < handler->RequiredArgs())
+      int numArgs = inlineValue ? 0 : handler->RequiredArgs();
+      if (argc - idx - 1 < numArgs)
       {
         error = string("Too few arguments left for: ") + argv[idx];
         return false;
       }
 
-      const char* arg = handler->RequiredArgs() ? argv[idx + 1] : nullptr;
+      const char* arg = handler->RequiredArgs() ? (inlineValue ? inlineValue : argv[idx + 1]) : nullptr;
       if (!handler->Process(arg))
       {
         error = string("Error processing argument: ") + (arg ? arg : "");
         return false;
       }
 
-      idx += handler->RequiredArgs() + 1;
+      idx += numArgs + 1;
     }
 
     return true;
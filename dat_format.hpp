@@ -0,0 +1,57 @@
+#pragma once
+
+//------------------------------------------------------------------------------
+// Layout of the .dat file written by JsonExporter.
+// The file starts with a DatHeader, followed by the sections, and ends with the section table. All
+// offsets are from the start of the file, and each section starts at a multiple of its alignment, so a
+// loader can map the file and point straight at the data. The json refers to a section by its index in
+// the section table, and also gives its offset and size.
+
+static const u32 DAT_MAGIC = 0x54414442;  // 'BDAT'
+static const u32 DAT_VERSION = 1;
+
+enum class DatSectionType : u32
+{
+  Generic = 0,
+  // the combined scene geometry, see JsonExporter::ExportWorldGeometry
+  WorldGeometry = 1,
+  // vertex, index and meshlet streams
+  MeshStream = 2,
+  AnimTrack = 3,
+  Sdf = 4,
+};
+
+//------------------------------------------------------------------------------
+struct DatHeader
+{
+  u32 magic;
+  u32 version;
+  u32 numSections;
+  u32 reserved;
+  u64 sectionTableOffset;
+  u64 fileSize;
+};
+static_assert(sizeof(DatHeader) == 32, "DatHeader is written out as is");
+
+//------------------------------------------------------------------------------
+struct DatSection
+{
+  DatSectionType type;
+  u32 alignment;
+  u64 offset;
+  u64 size;
+};
+static_assert(sizeof(DatSection) == 24, "DatSection is written out as is");
+
+//------------------------------------------------------------------------------
+inline u32 DatSectionAlignment(DatSectionType type)
+{
+  // sections that are uploaded to the gpu, or scanned in bulk, are cache line aligned
+  switch (type)
+  {
+    case DatSectionType::WorldGeometry:
+    case DatSectionType::MeshStream:
+    case DatSectionType::Sdf: return 64;
+    default: return 16;
+  }
+}
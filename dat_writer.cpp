@@ -0,0 +1,120 @@
+#include "dat_writer.hpp"
+#include "exporter_utils.hpp"
+
+static const size_t DAT_WRITE_BUFFER_SIZE = 1024 * 1024;
+static const size_t DAT_COMPARE_CHUNK_SIZE = 64 * 1024;
+
+//------------------------------------------------------------------------------
+DatWriter::~DatWriter()
+{
+  if (f)
+    fclose(f);
+}
+
+//------------------------------------------------------------------------------
+bool DatWriter::Open(const string& filename)
+{
+  // opened for update, so repeated sections can be compared against what's already written
+  f = fopen(filename.c_str(), "w+b");
+  if (!f)
+    return false;
+
+  setvbuf(f, nullptr, _IOFBF, DAT_WRITE_BUFFER_SIZE);
+
+  // the header is filled in by Close
+  DatHeader header = {};
+  Write(&header, sizeof(header));
+  return ok;
+}
+
+//------------------------------------------------------------------------------
+void DatWriter::Write(const void* data, size_t len)
+{
+  if (len && fwrite(data, len, 1, f) != 1)
+    ok = false;
+  size += len;
+}
+
+//------------------------------------------------------------------------------
+void DatWriter::Seek(u64 offset)
+{
+#ifdef _MSC_VER
+  int res = _fseeki64(f, (s64)offset, SEEK_SET);
+#else
+  int res = fseeko(f, (off_t)offset, SEEK_SET);
+#endif
+  if (res != 0)
+    ok = false;
+}
+
+//------------------------------------------------------------------------------
+bool DatWriter::SameData(const DatSection& section, const char* data, size_t len)
+{
+  // read the candidate back in chunks, and return to the end of the file for the next write
+  readBuf.resize(DAT_COMPARE_CHUNK_SIZE);
+  Seek(section.offset);
+  bool res = true;
+  for (size_t ofs = 0; ofs < len && res; ofs += DAT_COMPARE_CHUNK_SIZE)
+  {
+    size_t chunk = min(DAT_COMPARE_CHUNK_SIZE, len - ofs);
+    res = fread(readBuf.data(), chunk, 1, f) == 1 && memcmp(readBuf.data(), data + ofs, chunk) == 0;
+  }
+  Seek(size);
+  return res;
+}
+
+//------------------------------------------------------------------------------
+int DatWriter::AddSection(const char* data, size_t len, DatSectionType type, bool* deduped)
+{
+  u64 hash = FnvHash64(data, len);
+  auto range = sectionsByHash.equal_range(hash);
+  for (auto it = range.first; it != range.second; ++it)
+  {
+    const DatSection& section = sections[it->second];
+    if (section.type == type && section.size == len && SameData(section, data, len))
+    {
+      *deduped = true;
+      return it->second;
+    }
+  }
+
+  u32 alignment = DatSectionAlignment(type);
+  static const char padding[64] = {};
+  Write(padding, (size_t)((alignment - size % alignment) % alignment));
+
+  int idx = (int)sections.size();
+  sections.push_back(DatSection{type, alignment, size, len});
+  sectionsByHash.insert(make_pair(hash, idx));
+  Write(data, len);
+  *deduped = false;
+  return idx;
+}
+
+//------------------------------------------------------------------------------
+bool DatWriter::Close()
+{
+  if (!f)
+    return true;
+
+  static const char padding[16] = {};
+  Write(padding, (size_t)((16 - size % 16) % 16));
+
+  DatHeader header;
+  header.magic = DAT_MAGIC;
+  header.version = DAT_VERSION;
+  header.numSections = (u32)sections.size();
+  header.reserved = 0;
+  header.sectionTableOffset = size;
+
+  Write(sections.data(), sections.size() * sizeof(DatSection));
+  header.fileSize = size;
+
+  Seek(0);
+  if (fwrite(&header, sizeof(header), 1, f) != 1)
+    ok = false;
+
+  if (fclose(f) != 0)
+    ok = false;
+  f = nullptr;
+  return ok;
+}
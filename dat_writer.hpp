@@ -0,0 +1,36 @@
+#pragma once
+#include "dat_format.hpp"
+
+//------------------------------------------------------------------------------
+// Writes a .dat file (see dat_format.hpp) one section at a time, straight to disk. Only the section
+// table is kept in memory, and the header is filled in by Close. Repeated sections of the same type
+// are found by hash and verified against the file, and point at the first copy.
+class DatWriter
+{
+public:
+  ~DatWriter();
+
+  bool Open(const string& filename);
+  bool IsOpen() const { return f != nullptr; }
+
+  // returns the index of the section holding the data, and sets deduped if it was already in the file
+  int AddSection(const char* data, size_t len, DatSectionType type, bool* deduped);
+  const DatSection& Section(int idx) const { return sections[idx]; }
+
+  // writes the section table and header, and closes the file. returns false if any write failed
+  bool Close();
+
+  u64 Size() const { return size; }
+
+private:
+  void Write(const void* data, size_t len);
+  void Seek(u64 offset);
+  bool SameData(const DatSection& section, const char* data, size_t len);
+
+  FILE* f = nullptr;
+  u64 size = 0;
+  bool ok = true;
+  vector<DatSection> sections;
+  std::unordered_multimap<u64, int> sectionsByHash;
+  vector<char> readBuf;
+};
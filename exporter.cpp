@@ -5,8 +5,11 @@
 
 #include "exporter.hpp"
 #include "arg_parse.hpp"
+#include "dat_format.hpp"
 #include "exporter_utils.hpp"
+#include "im_exporter.hpp"
 #include "json_exporter.hpp"
+#include "keyframe_reduce.hpp"
 #include "melange_helpers.hpp"
 #include <dlib/filewatcher_win32.hpp>
 
@@ -19,12 +22,21 @@ namespace
     // convert back slashes to forward
     return ReplaceAll(str, '\\', '/');
   }
+
+  //------------------------------------------------------------------------------
+  struct ExportTask
+  {
+    string inputFilename;
+    string outputFilename;
+    // hash of the input and options, taken before the input is read
+    u64 exportHash;
+  };
 }
 
-ExportInstance g_ExportInstance;
+// bump when a change to the exporter changes its output, so existing exports are redone
+static const u32 EXPORTER_VERSION = 1;
 
-u32 ImScene::nextObjectId = 1;
-u32 ImMaterial::nextId;
+thread_local ExportInstance g_ExportInstance;
 
 //-----------------------------------------------------------------------------
 void ExportInstance::Log(int level, const char* fmt, ...) const
@@ -58,6 +70,8 @@ ExportInstance::~ExportInstance()
 void ExportInstance::Reset()
 {
   deferredFunctions.clear();
+  pendingMeshes.clear();
+  profiler.Reset();
   delete scene;
   scene = nullptr;
 
@@ -96,6 +110,56 @@ string FilenameFromInput(const string& inputFilename, bool stripPath)
   return string();
 }
 
+//-----------------------------------------------------------------------------
+static u64 ExportHash(const Options& options, const string& inputFilename)
+{
+  // hash of the exporter and .dat versions, the input file, and all the options that affect the output
+  u64 seed = FnvHash64(&EXPORTER_VERSION, sizeof(EXPORTER_VERSION));
+  seed = FnvHash64(&DAT_VERSION, sizeof(DAT_VERSION), seed);
+
+  u64 hash;
+  if (!HashFile(inputFilename, &hash, seed))
+    return 0;
+
+  auto fnHash = [&hash](const auto& v) { hash = FnvHash64(&v, sizeof(v), hash); };
+  fnHash(options.optimizeIndices);
+  fnHash(options.compressVertices);
+  fnHash(options.compressIndices);
+  fnHash(options.lods);
+  fnHash(options.meshlets);
+  fnHash(options.keyTolerance);
+  fnHash(options.sdf);
+  fnHash(options.gridSize);
+  fnHash(options.sdfMethod);
+  fnHash(options.sdfExactBand);
+  fnHash(options.sdfBricks);
+  fnHash(options.sdfFormat);
+  fnHash(options.sdfTruncation);
+  return hash;
+}
+
+//-----------------------------------------------------------------------------
+static bool ReadExportHash(const string& outputFilename, u64* hash)
+{
+  FILE* f = fopen((outputFilename + ".hash").c_str(), "rt");
+  if (!f)
+    return false;
+
+  bool res = fscanf(f, "%llx", hash) == 1;
+  fclose(f);
+  return res;
+}
+
+//-----------------------------------------------------------------------------
+static void WriteExportHash(const string& outputFilename, u64 hash)
+{
+  if (FILE* f = fopen((outputFilename + ".hash").c_str(), "wt"))
+  {
+    fprintf(f, "%.16llx\n", hash);
+    fclose(f);
+  }
+}
+
 //------------------------------------------------------------------------------
 ImBaseObject* ImScene::FindObject(melange::BaseObject* obj)
 {
@@ -123,37 +187,68 @@ ImMaterial* ImScene::FindMaterial(melange::BaseMaterial* mat)
 }
 
 //-----------------------------------------------------------------------------
-void ExportAnimations()
+static void SampleGlobalTransforms()
 {
-  melange::GeData mydata;
-  float startTime = 0.0, endTime = 0.0;
-  int startFrame = 0, endFrame = 0, fps = 0;
-
-  // get fps
-  if (g_ExportInstance.doc->GetParameter(melange::DOCUMENT_FPS, mydata))
-    fps = mydata.GetInt32();
-
-  // get start and end time
-  if (g_ExportInstance.doc->GetParameter(melange::DOCUMENT_MINTIME, mydata))
-    startTime = mydata.GetTime().Get();
-
-  if (g_ExportInstance.doc->GetParameter(melange::DOCUMENT_MAXTIME, mydata))
-    endTime = mydata.GetTime().Get();
-
-  // calculate start and end frame
-  startFrame = startTime * fps;
-  endFrame = endTime * fps;
-
-  float inc = 1.0f / fps;
-  float curTime = startTime;
+  // evaluate the document once per frame, and capture the global transform of every object. objects
+  // that don't move get no samples
+  ImScene* scene = g_ExportInstance.scene;
+  int startFrame = (int)(scene->startTime * scene->fps);
+  int endFrame = (int)(scene->endTime * scene->fps);
+  if (scene->fps <= 0 || endFrame < startFrame)
+    return;
+
+  // sort by id, so the objects are visited in the same order on every export
+  vector<pair<melange::BaseObject*, ImBaseObject*>> objects(
+      scene->melangeToImObject.begin(), scene->melangeToImObject.end());
+  sort(objects.begin(), objects.end(), [](const auto& lhs, const auto& rhs) {
+    return lhs.second->id < rhs.second->id;
+  });
+
+  int numFrames = endFrame - startFrame + 1;
+  for (auto& kv : objects)
+  {
+    ImBakedTransforms& baked = kv.second->bakedXformGlobal;
+    baked.startFrame = startFrame;
+    baked.pos.resize(numFrames);
+    baked.quat.resize(numFrames);
+    baked.scale.resize(numFrames);
+  }
 
-  while (curTime <= endTime)
+  for (int frame = startFrame; frame <= endFrame; ++frame)
   {
-    g_ExportInstance.doc->SetTime(melange::BaseTime(curTime));
+    g_ExportInstance.doc->SetTime(melange::BaseTime((float)frame / scene->fps));
     g_ExportInstance.doc->Execute();
 
-    curTime += inc;
+    int idx = frame - startFrame;
+    for (auto& kv : objects)
+    {
+      // same as CopyBaseTransform
+      melange::BaseObject* melangeObj = kv.first;
+      ImTransform xform;
+      CopyTransform(melangeObj->GetUpMg() * melangeObj->GetMl(), &xform);
+
+      ImBakedTransforms& baked = kv.second->bakedXformGlobal;
+      baked.pos[idx] = xform.pos;
+      baked.quat[idx] = xform.quat;
+      baked.scale[idx] = xform.scale;
+    }
+  }
+
+  int numAnimated = 0;
+  for (auto& kv : objects)
+  {
+    ImBakedTransforms& baked = kv.second->bakedXformGlobal;
+    if (baked.IsConstant())
+      baked = ImBakedTransforms();
+    else
+      numAnimated++;
   }
+
+  g_ExportInstance.Log(2,
+      "sampled transforms: %d frames, %d of %d objects animated\n",
+      numFrames,
+      numAnimated,
+      (int)objects.size());
 }
 
 //-----------------------------------------------------------------------------
@@ -171,6 +266,7 @@ static void CollectAnimationTracks()
   if (g_ExportInstance.doc->GetParameter(melange::DOCUMENT_MAXTIME, mydata))
     g_ExportInstance.scene->endTime = mydata.GetTime().Get();
 
+  int numSamples = 0, numKeys = 0;
   for (melange::BaseObject* obj = g_ExportInstance.doc->GetFirstObject(); obj; obj = obj->GetNext())
   {
     for (melange::CTrack* track = obj->GetFirstCTrack(); track; track = track->GetNext())
@@ -204,16 +300,37 @@ static void CollectAnimationTracks()
         curTime += inc;
       }
 
+      if (g_ExportInstance.options.keyTolerance > 0)
+      {
+        // replace the samples with the fewest keys that stay within the tolerance
+        ImCurve curve;
+        curve.name = imTrack.name;
+        ReduceKeyframes(imTrack.values, startFrame, g_ExportInstance.options.keyTolerance, &curve);
+        numSamples += (int)imTrack.values.size();
+        numKeys += (int)curve.keyframes.size();
+
+        ImTrack keyedTrack;
+        keyedTrack.name = imTrack.name;
+        keyedTrack.curves.push_back(curve);
+        imObj->animTracks.push_back(keyedTrack);
+        continue;
+      }
+
       imObj->sampledAnimTracks.push_back(imTrack);
     }
   }
+
+  if (g_ExportInstance.options.keyTolerance > 0)
+    g_ExportInstance.Log(2, "keyframe reduction: %d samples -> %d keys\n", numSamples, numKeys);
 }
 
 //-----------------------------------------------------------------------------
-bool ExportFile(const string& inputFilename, const string& outputFilename)
+bool ExportFile(
+    const Options& options, const string& inputFilename, const string& outputFilename, u64 exportHash)
 {
   g_ExportInstance.Reset();
   g_ExportInstance.scene = new ImScene();
+  g_ExportInstance.options = options;
   g_ExportInstance.options.inputFilename = inputFilename;
 
   const char* lastSlash = strrchr(outputFilename.c_str(), '/');
@@ -243,41 +360,71 @@ bool ExportFile(const string& inputFilename, const string& outputFilename)
     g_ExportInstance.options.inputFilename.c_str(),
     outputFilename.c_str());
 
+  Profiler* profiler = &g_ExportInstance.profiler;
   g_ExportInstance.doc = NewObj(melange::AlienBaseDocument);
   g_ExportInstance.file = NewObj(melange::HyperFile);
 
-  if (!g_ExportInstance.file->Open(
-    DOC_IDENT, g_ExportInstance.options.inputFilename.c_str(), melange::FILEOPEN_READ))
-    return false;
+  {
+    ScopedStage stage(profiler, "read document");
+    if (!g_ExportInstance.file->Open(
+      DOC_IDENT, g_ExportInstance.options.inputFilename.c_str(), melange::FILEOPEN_READ))
+      return false;
 
-  if (!g_ExportInstance.doc->ReadObject(g_ExportInstance.file, true))
-    return false;
+    if (!g_ExportInstance.doc->ReadObject(g_ExportInstance.file, true))
+      return false;
+
+    g_ExportInstance.file->Close();
+  }
 
-  g_ExportInstance.file->Close();
+  {
+    ScopedStage stage(profiler, "collect materials");
+    CollectMaterials(g_ExportInstance.doc);
+    CollectMaterials2(g_ExportInstance.doc);
+  }
 
-  CollectMaterials(g_ExportInstance.doc);
-  CollectMaterials2(g_ExportInstance.doc);
-  g_ExportInstance.doc->CreateSceneFromC4D();
+  {
+    ScopedStage stage(profiler, "CreateSceneFromC4D");
+    g_ExportInstance.doc->CreateSceneFromC4D();
+  }
+
+  {
+    ScopedStage stage(profiler, "build meshes");
+    BuildPendingMeshes();
+  }
 
   bool res = true;
-  for (auto& fn : g_ExportInstance.deferredFunctions)
   {
-    res &= fn();
-    if (!res)
-      break;
+    ScopedStage stage(profiler, "deferred fixups");
+    for (auto& fn : g_ExportInstance.deferredFunctions)
+    {
+      res &= fn();
+      if (!res)
+        break;
+    }
   }
 
-  CollectAnimationTracks();
+  {
+    ScopedStage stage(profiler, "CollectAnimationTracks");
+    CollectAnimationTracks();
+  }
 
-  ExportAnimations();
+  {
+    ScopedStage stage(profiler, "sample transforms");
+    SampleGlobalTransforms();
+  }
 
   SceneStats stats;
   if (res)
   {
+    ScopedStage stage(profiler, "json export");
     JsonExporter exporter(&g_ExportInstance);
-    exporter.Export(&stats);
+    res = exporter.Export(&stats);
   }
 
+  // only record the hash if the export succeeded, so a failed export is retried next time
+  if (res)
+    WriteExportHash(outputFilename, exportHash);
+
   g_ExportInstance.Log(
     2,
     "--> stats: \n"
@@ -288,7 +435,8 @@ bool ExportFile(const string& inputFilename, const string& outputFilename)
     "    material object size: %.2f kb\n"
     "    spline object size: %.2f kb\n"
     "    animation object size: %.2f kb\n"
-    "    data object size: %.2f kb\n",
+    "    data object size: %.2f kb\n"
+    "    deduplicated data: %.2f kb in %d blobs\n",
     (float)stats.nullObjectSize / 1024,
     (float)stats.cameraSize / 1024,
     (float)stats.meshSize / 1024,
@@ -296,7 +444,17 @@ bool ExportFile(const string& inputFilename, const string& outputFilename)
     (float)stats.materialSize / 1024,
     (float)stats.splineSize / 1024,
     (float)stats.animationSize / 1024,
-    (float)stats.dataSize / 1024);
+    (float)stats.dataSize / 1024,
+    (float)stats.dedupedSize / 1024,
+    stats.dedupedBlobs);
+
+  profiler->Log(g_ExportInstance);
+  if (g_ExportInstance.options.trace)
+  {
+    string traceFilename = g_ExportInstance.options.outputPrefix + ".trace.json";
+    if (!profiler->WriteChromeTrace(traceFilename))
+      g_ExportInstance.Log(1, "Unable to write trace file: %s\n", traceFilename.c_str());
+  }
 
   time_t endTime = time(0);
   now = localtime(&endTime);
@@ -314,21 +472,71 @@ bool ExportFile(const string& inputFilename, const string& outputFilename)
   if (g_ExportInstance.options.logfile)
     fclose(g_ExportInstance.options.logfile);
 
-  return true;
+  return res;
+}
+
+//-----------------------------------------------------------------------------
+static void ExportFilesParallel(const Options& options, const vector<ExportTask>& files)
+{
+  int numWorkers = min(options.jobs, (int)files.size());
+
+  // unless given, split the hardware threads between the workers, so each file's mesh and sdf passes
+  // don't start one thread per core on top of the other workers
+  Options workerOptions = options;
+  if (workerOptions.threads <= 0)
+    workerOptions.threads = max(1, (int)std::thread::hardware_concurrency() / numWorkers);
+
+  // each worker grabs the next file from the list, and exports it using its own thread local
+  // export instance
+  std::atomic<size_t> nextFile(0);
+  auto fnWorker = [&]() {
+    while (true)
+    {
+      size_t idx = nextFile++;
+      if (idx >= files.size())
+        break;
+      const ExportTask& task = files[idx];
+      ExportFile(workerOptions, task.inputFilename, task.outputFilename, task.exportHash);
+    }
+    g_ExportInstance.Reset();
+  };
+
+  vector<std::thread> workers;
+  for (int i = 0; i < numWorkers; ++i)
+    workers.push_back(std::thread(fnWorker));
+
+  for (std::thread& t : workers)
+    t.join();
 }
 
 //-----------------------------------------------------------------------------
 int main(int argc, char** argv)
 {
+  Options options;
+
   ArgParse parser;
-  parser.AddFlag(nullptr, "compress-vertices", &g_ExportInstance.options.compressVertices);
-  parser.AddFlag(nullptr, "compress-indices", &g_ExportInstance.options.compressIndices);
-  parser.AddFlag(nullptr, "optimize-indices", &g_ExportInstance.options.optimizeIndices);
-  parser.AddFlag("f", "force", &g_ExportInstance.options.force);
-  parser.AddFlag(nullptr, "sdf", &g_ExportInstance.options.sdf);
-  parser.AddIntArgument(nullptr, "loglevel", &g_ExportInstance.options.loglevel);
-  parser.AddStringArgument("o", nullptr, &g_ExportInstance.options.outputDirectory);
-  parser.AddIntArgument(nullptr, "grid-size", &g_ExportInstance.options.gridSize);
+  parser.AddFlag(nullptr, "compress-vertices", &options.compressVertices);
+  parser.AddFlag(nullptr, "compress-indices", &options.compressIndices);
+  parser.AddFlag(nullptr, "optimize-indices", &options.optimizeIndices);
+  parser.AddIntArgument(nullptr, "lods", &options.lods);
+  parser.AddFlag(nullptr, "meshlets", &options.meshlets);
+  parser.AddFloatArgument(nullptr, "key-tolerance", &options.keyTolerance);
+  parser.AddFlag("f", "force", &options.force);
+  parser.AddFlag(nullptr, "sdf", &options.sdf);
+  parser.AddIntArgument(nullptr, "loglevel", &options.loglevel);
+  parser.AddFlag(nullptr, "trace", &options.trace);
+  parser.AddStringArgument("o", nullptr, &options.outputDirectory);
+  parser.AddIntArgument(nullptr, "grid-size", &options.gridSize);
+  string sdfMethod;
+  parser.AddStringArgument(nullptr, "sdf-method", &sdfMethod);
+  parser.AddIntArgument(nullptr, "sdf-exact-band", &options.sdfExactBand);
+  parser.AddFlag(nullptr, "sdf-bricks", &options.sdfBricks);
+  string sdfFormat;
+  parser.AddStringArgument(nullptr, "sdf-format", &sdfFormat);
+  parser.AddFloatArgument(nullptr, "sdf-truncation", &options.sdfTruncation);
+  parser.AddFlag(nullptr, "sdf-report-error", &options.sdfReportError);
+  parser.AddIntArgument("j", "jobs", &options.jobs);
+  parser.AddIntArgument(nullptr, "threads", &options.threads);
 
   if (!parser.Parse(argc - 1, argv + 1))
   {
@@ -343,7 +551,44 @@ int main(int argc, char** argv)
     return 1;
   }
 
-  vector<pair<string, string>> files;
+  if (!sdfMethod.empty())
+  {
+    static const unordered_map<string, SdfMethod> sdfMethods = {
+        {"bvh", SdfMethod::Bvh},
+        {"sweep", SdfMethod::Sweep},
+        {"brute", SdfMethod::Brute},
+    };
+
+    auto it = sdfMethods.find(sdfMethod);
+    if (it == sdfMethods.end())
+    {
+      fprintf(stderr, "Invalid sdf method: %s (valid are bvh, sweep and brute)\n", sdfMethod.c_str());
+      return 1;
+    }
+    options.sdfMethod = it->second;
+  }
+
+  if (!sdfFormat.empty())
+  {
+    static const unordered_map<string, SdfFormat> sdfFormats = {
+        {"float", SdfFormat::Float},
+        {"snorm8", SdfFormat::Snorm8},
+        {"snorm16", SdfFormat::Snorm16},
+    };
+
+    auto it = sdfFormats.find(sdfFormat);
+    if (it == sdfFormats.end())
+    {
+      fprintf(stderr, "Invalid sdf format: %s (valid are float, snorm8 and snorm16)\n", sdfFormat.c_str());
+      return 1;
+    }
+    options.sdfFormat = it->second;
+  }
+
+  if (options.jobs <= 0)
+    options.jobs = max(1, (int)std::thread::hardware_concurrency());
+
+  vector<ExportTask> files;
 
   WIN32_FIND_DATAA findData;
   const char* glob = parser.positional.front().c_str();
@@ -358,8 +603,7 @@ int main(int argc, char** argv)
   while (true)
   {
     const char* filename = &findData.cFileName[0];
-    string outputFilename =
-      g_ExportInstance.options.outputDirectory + string("/") + FilenameFromInput(filename, false);
+    string outputFilename = options.outputDirectory + string("/") + FilenameFromInput(filename, false);
 
     // normalize input directory
     for (char* ptr = (char*)glob; *ptr; ++ptr)
@@ -371,26 +615,28 @@ int main(int argc, char** argv)
     // get input dir
     const char* lastInputSlash = strrchr(glob, '/');
     string inputDir(glob, lastInputSlash - glob + 1);
-    g_ExportInstance.options.inputFilename = inputDir + filename;
+    string inputFilename = inputDir + filename;
     outputFilename = MakeCanonical(outputFilename);
 
-    // skip the file if the output file is older than the input
+    // hash the input before reading it, so any changes made during the export trigger a new one
+    u64 exportHash = ExportHash(options, inputFilename);
+
+    // skip the file if the input and options hash the same as the last successful export
     bool processFile = true;
 
-    // skip checking timestamps is the force flag is given
-    if (!g_ExportInstance.options.force)
+    // skip checking the hash if the force flag is given
+    if (!options.force)
     {
-      struct stat statInput;
       struct stat statOutput;
-      if (stat(g_ExportInstance.options.inputFilename.c_str(), &statInput) == 0
-        && stat(outputFilename.c_str(), &statOutput) == 0)
+      u64 prevHash;
+      if (stat(outputFilename.c_str(), &statOutput) == 0 && ReadExportHash(outputFilename, &prevHash))
       {
-        processFile = statInput.st_mtime > statOutput.st_mtime;
+        processFile = prevHash != exportHash;
       }
     }
 
     if (processFile)
-      files.push_back(make_pair(g_ExportInstance.options.inputFilename, outputFilename));
+      files.push_back(ExportTask{inputFilename, outputFilename, exportHash});
 
     if (!FindNextFileA(h, &findData))
       break;
@@ -398,11 +644,21 @@ int main(int argc, char** argv)
 
   FindClose(h);
 
+  // with multiple jobs, do the initial export on the worker pool, and only use the file watcher
+  // for subsequent changes
+  bool parallel = options.jobs > 1 && files.size() > 1;
+  if (parallel)
+    ExportFilesParallel(options, files);
+
   FileWatcherWin32 watcher;
-  for (size_t i = 0; i < files.size(); ++i)
+  for (const ExportTask& task : files)
   {
-    watcher.AddFileWatch(files[i].first, true, [=](const std::string& filename) {
-      ExportFile(files[i].first, files[i].second);
+    // the initial export uses the hash from above, and later ones rehash the changed input
+    u64 initialHash = parallel ? 0 : task.exportHash;
+    watcher.AddFileWatch(task.inputFilename, !parallel, [=](const std::string& filename) mutable {
+      u64 exportHash = initialHash ? initialHash : ExportHash(options, task.inputFilename);
+      initialHash = 0;
+      ExportFile(options, task.inputFilename, task.outputFilename, exportHash);
       return true;
     });
   }
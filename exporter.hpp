@@ -1,5 +1,6 @@
 #pragma once
 #include "im_scene.hpp"
+#include "profiler.hpp"
 
 #define WITH_XFORM_MTX 0
 
@@ -12,6 +13,24 @@ namespace melange
   class AlienMaterial;
 }
 
+enum class SdfMethod
+{
+  // closest point queries against a triangle bvh
+  Bvh,
+  // exact distances in a narrow band around the triangles, and fast sweeping for the rest
+  Sweep,
+  // closest point queries against every triangle, mostly useful for validating the others
+  Brute,
+};
+
+enum class SdfFormat
+{
+  Float,
+  // signed normalized against the SDF range, values outside the range are clamped
+  Snorm8,
+  Snorm16,
+};
+
 struct Options
 {
   string inputFilename;
@@ -27,6 +46,28 @@ struct Options
   bool force = false;
   bool sdf = false;
   int gridSize = 32;
+  SdfMethod sdfMethod = SdfMethod::Bvh;
+  // for the sweep method, the number of cells around each triangle with exact distances
+  int sdfExactBand = 1;
+  // store the SDF as 8^3 bricks near the surface instead of a dense grid
+  bool sdfBricks = false;
+  SdfFormat sdfFormat = SdfFormat::Float;
+  // truncation distance for the snorm formats, 0 = the largest distance in the volume
+  float sdfTruncation = 0;
+  // log the max error between the quantized and float SDF values
+  bool sdfReportError = false;
+  // number of simplified LODs to generate for each mesh, each with half the triangles of the previous
+  int lods = 0;
+  // split each material group into meshlets, with bounds for cluster culling
+  bool meshlets = false;
+  // fit the sampled animation tracks with keyframes, within this absolute error. 0 = keep every frame
+  float keyTolerance = 0;
+  // write a chrome trace_event file with the stage timings to <output>.trace.json
+  bool trace = false;
+  int jobs = 1;
+  // threads used for building meshes and generating the SDF, 0 = the hardware threads split between
+  // the jobs
+  int threads = 0;
 };
 
 //------------------------------------------------------------------------------
@@ -40,6 +81,9 @@ struct SceneStats
   int splineSize = 0;
   int animationSize = 0;
   int dataSize = 0;
+  // repeated blobs that point at an existing copy in the data buffer, instead of being stored again
+  int dedupedSize = 0;
+  int dedupedBlobs = 0;
 };
 
 namespace melange
@@ -48,6 +92,8 @@ namespace melange
   class HyperFile;
 }
 
+struct MeshSource;
+
 struct ExportInstance
 {
   ~ExportInstance();
@@ -57,9 +103,14 @@ struct ExportInstance
   Options options;
   // Fixup functions called after the scene has been read and processed.
   vector<function<bool()>> deferredFunctions;
+  // Meshes that have been read, but not built yet. See BuildPendingMeshes.
+  vector<shared_ptr<MeshSource>> pendingMeshes;
   melange::AlienBaseDocument* doc = nullptr;
   melange::HyperFile* file = nullptr;
+  Profiler profiler;
 };
 
-extern ExportInstance g_ExportInstance;
+// Each export job runs on its own thread, so the instance (and the scene it owns) is per thread. The
+// melange callbacks don't take a context pointer, so this is how they find the current scene.
+extern thread_local ExportInstance g_ExportInstance;
 
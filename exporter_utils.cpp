@@ -3,10 +3,7 @@
 #include "melange_helpers.hpp"
 #include <c4d_quaternion.h>
 
-IdGenerator g_ObjectId(0);
-IdGenerator g_MaterialId(1);
-unordered_map<int, melange::BaseMaterial*> g_MaterialIdToObj;
-extern ExportInstance g_ExportInstance;
+extern thread_local ExportInstance g_ExportInstance;
 
 //-----------------------------------------------------------------------------
 string ReplaceAll(const string& str, char toReplace, char replaceWith)
@@ -33,6 +30,36 @@ string ReplaceAll(const string& str, char toReplace, char replaceWith)
   return res;
 }
 
+//-----------------------------------------------------------------------------
+u64 FnvHash64(const void* data, size_t len, u64 hash)
+{
+  // 64 bit FNV-1a
+  const u8* ptr = (const u8*)data;
+  for (size_t i = 0; i < len; ++i)
+  {
+    hash ^= ptr[i];
+    hash *= 0x100000001b3ull;
+  }
+  return hash;
+}
+
+//-----------------------------------------------------------------------------
+bool HashFile(const string& filename, u64* hash, u64 seed)
+{
+  FILE* f = fopen(filename.c_str(), "rb");
+  if (!f)
+    return false;
+
+  u64 res = seed;
+  vector<u8> buf(64 * 1024);
+  while (size_t numRead = fread(buf.data(), 1, buf.size(), f))
+    res = FnvHash64(buf.data(), numRead, res);
+
+  fclose(f);
+  *hash = res;
+  return true;
+}
+
 //-----------------------------------------------------------------------------
 void CopyTransform(const melange::Matrix& mtx, ImTransform* xform)
 {
@@ -148,7 +175,7 @@ void CollectionAnimationTracksForObj(melange::BaseList2D* bl, vector<ImTrack>* t
         melange::BaseTime t = ck->GetTime();
         if (track->GetTrackCategory() == melange::PSEUDO_VALUE)
         {
-          curve.keyframes.push_back(ImKeyframe{(int)t.GetFrame(g_ExportInstance.doc->GetFps()), (float)ck->GetValue()});
+          curve.keyframes.push_back(ImKeyframe{(int)t.GetFrame(g_ExportInstance.doc->GetFps()), (float)ck->GetValue(), 0});
         }
         else if (track->GetTrackCategory() == melange::PSEUDO_PLUGIN && track->GetType() == CTpla)
         {
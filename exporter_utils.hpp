@@ -22,6 +22,9 @@ void CollectMaterials2(melange::AlienBaseDocument* c4dDoc);
 string CopyString(const melange::String& str);
 string ReplaceAll(const string& str, char toReplace, char replaceWith);
 
+u64 FnvHash64(const void* data, size_t len, u64 hash = 0xcbf29ce484222325ull);
+bool HashFile(const string& filename, u64* hash, u64 seed = 0xcbf29ce484222325ull);
+
 
 //-----------------------------------------------------------------------------
 template <typename R, typename T>
@@ -92,8 +95,3 @@ void operator+=(vector<T>& lhs, const vector<T>& rhs)
 {
   lhs.insert(lhs.end(), rhs.begin(), rhs.end());
 }
-
-extern IdGenerator g_ObjectId;
-extern IdGenerator g_MaterialId;
-extern unordered_map<int, melange::BaseMaterial*> g_MaterialIdToObj;
-
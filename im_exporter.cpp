@@ -2,6 +2,11 @@
 #include "exporter_utils.hpp"
 #include "im_exporter.hpp"
 #include "melange_helpers.hpp"
+#include "mesh_compress.hpp"
+#include "mesh_simplify.hpp"
+#include "mesh_meshlets.hpp"
+#include "parallel.hpp"
+#include "compress/forsythtriangleorderoptimizer.h"
 
 using namespace melange;
 
@@ -18,6 +23,9 @@ using namespace melange;
 //-----------------------------------------------------------------------------
 static const float DEFAULT_NEAR_PLANE = 1.0f;
 static const float DEFAULT_FAR_PLANE = 1000.0f;
+// lru cache size used when optimizing, and the fifo size used when measuring the result
+static const int OPTIMIZE_LRU_CACHE_SIZE = 32;
+static const int MEASURE_FIFO_CACHE_SIZE = 16;
 static AlienMaterial* DEFAULT_MATERIAL_PTR = nullptr;
 
 static unordered_map<int, string> areaLightShapeToString = {
@@ -30,7 +38,7 @@ static unordered_map<int, string> areaLightShapeToString = {
     {LIGHT_AREADETAILS_SHAPE_LINE, "line"},
 };
 
-extern ExportInstance g_ExportInstance;
+extern thread_local ExportInstance g_ExportInstance;
 
 //-----------------------------------------------------------------------------
 static void ExportSpline(melange::BaseObject* obj)
@@ -411,101 +419,78 @@ static void CalcBoundingVolumes(const Vector* verts, int vertexCount, ImSphere*
   *aabb = {minValue, maxValue};
 }
 
-//-----------------------------------------------------------------------------
-static u32 FnvHash(const char* str, u32 d = 0x01000193)
-{
-  while (true)
-  {
-    char c = *str++;
-    if (!c)
-      return d;
-    d = ((d * 0x01000193) ^ c) & 0xffffffff;
-  }
-}
-
 //-----------------------------------------------------------------------------
 struct FatVertex
 {
-  FatVertex()
-  {
-    memset(this, 0, sizeof(FatVertex));
-  }
-
   Vector32 pos = Vector32(0, 0, 0);
   Vector32 normal = Vector32(0, 0, 0);
   Vector32 uv = Vector32(0, 0, 0);
 
-  u32 GetHash() const
+  u32 Hash() const
   {
-    if (meta.hash == 0)
-      meta.hash = FnvHash((const char*)this, sizeof(FatVertex) - sizeof(meta));
-    return meta.hash;
+    // mix all the float bits, with -0 hashed as 0 so the hash agrees with operator==
+    const float* values = &pos.x;
+    u64 h = 0;
+    for (int i = 0; i < 9; ++i)
+    {
+      u32 bits;
+      memcpy(&bits, &values[i], sizeof(bits));
+      bits = bits == 0x80000000 ? 0 : bits;
+      h = (h ^ bits) * 0x9e3779b97f4a7c15ull;
+      h ^= h >> 29;
+    }
+    return (u32)(h ^ (h >> 32));
   }
 
   friend bool operator==(const FatVertex& lhs, const FatVertex& rhs)
   {
     return lhs.pos == rhs.pos && lhs.normal == rhs.normal && lhs.uv == rhs.uv;
   }
+};
+static_assert(sizeof(FatVertex) == 9 * sizeof(float), "FatVertex::Hash expects 9 packed floats");
 
-  struct Hash
-  {
-    size_t operator()(const FatVertex& v) const
-    {
-      return v.GetHash();
-    }
-  };
-
-  struct
-  {
-    int id = 0;
-    mutable u32 hash = 0;
-  } meta;
+//-----------------------------------------------------------------------------
+struct MeshSource
+{
+  // The raw melange data for a mesh. This is captured in AlienPolygonObjectData::Execute, so the mesh
+  // can be built later on any thread without touching melange.
+  ImMesh* mesh = nullptr;
+  vector<Vector> verts;
+  vector<CPolygon> polys;
+  // 4 per polygon, from the normal or phong tag. empty if the mesh has neither
+  vector<Vector32> normals;
+  // 4 per polygon, empty if the mesh has no uvw tag
+  vector<Vector32> uvs;
+  // the polygons for each material id
+  vector<pair<int, vector<int>>> polysByMaterial;
 };
 
 //-----------------------------------------------------------------------------
 struct FatVertexSupplier
 {
-  FatVertexSupplier(PolygonObject* polyObj)
-  {
-    hasNormalsTag = !!polyObj->GetTag(Tnormal);
-    hasPhongTag = !!polyObj->GetTag(Tphong);
-    hasNormals = hasNormalsTag || hasPhongTag;
-
-    phongNormals = hasPhongTag ? polyObj->CreatePhongNormals() : nullptr;
-    normals = hasNormalsTag ? (NormalTag*)polyObj->GetTag(Tnormal) : nullptr;
-    uvs = (UVWTag*)polyObj->GetTag(Tuvw);
-    uvHandle = uvs ? uvs->GetDataAddressR() : nullptr;
-    normalHandle = normals ? normals->GetDataAddressR() : nullptr;
-
-    verts = polyObj->GetPointR();
-    polys = polyObj->GetPolygonR();
-  }
-
-  ~FatVertexSupplier()
+  FatVertexSupplier(const MeshSource& src) : src(src)
   {
-    if (phongNormals)
-      _MemFree((void**)&phongNormals);
+    // most vertices are shared between polygons, so the polygon count is a decent guess at the number
+    // of unique vertices
+    int expectedVerts = max(16, (int)src.polys.size());
+    fatVerts.reserve(expectedVerts);
+    int numSlots = 16;
+    while (numSlots < expectedVerts * 2)
+      numSlots *= 2;
+    slots.resize(numSlots);
   }
 
   int AddVertex(int polyIdx, int vertIdx)
   {
-    const CPolygon& poly = polys[polyIdx];
+    const CPolygon& poly = src.polys[polyIdx];
+    const Vector* verts = src.verts.data();
 
     FatVertex vtx;
     vtx.pos = Vector3Coerce<Vector32>(verts[AlphabetIndex<int>(poly, vertIdx)]);
 
-    if (hasNormals)
+    if (!src.normals.empty())
     {
-      if (hasNormalsTag)
-      {
-        NormalStruct normal;
-        normals->Get(normalHandle, polyIdx, normal);
-        vtx.normal = Vector3Coerce<Vector32>(AlphabetIndex<Vector>(normal, vertIdx));
-      }
-      else if (hasPhongTag)
-      {
-        vtx.normal = phongNormals[polyIdx * 4 + vertIdx];
-      }
+      vtx.normal = src.normals[polyIdx * 4 + vertIdx];
     }
     else
     {
@@ -516,38 +501,58 @@ struct FatVertexSupplier
       vtx.normal = Vector3Coerce<Vector32>(CalcNormal(verts[idx0], verts[idx1], verts[idx2]));
     }
 
-    if (uvHandle)
+    if (!src.uvs.empty())
     {
-      UVWStruct s;
-      UVWTag::Get(uvHandle, polyIdx, s);
-      vtx.uv = Vector3Coerce<Vector32>(AlphabetIndex<Vector>(s, vertIdx));
+      vtx.uv = src.uvs[polyIdx * 4 + vertIdx];
     }
 
     // Check if the fat vertex already exists
-    auto it = fatVertSet.find(vtx);
-    if (it != fatVertSet.end())
-      return it->meta.id;
+    u32 hash = vtx.Hash();
+    u32 mask = (u32)slots.size() - 1;
+    for (u32 i = hash & mask;; i = (i + 1) & mask)
+    {
+      Slot& slot = slots[i];
+      if (slot.idx == -1)
+      {
+        slot.hash = hash;
+        slot.idx = (int)fatVerts.size();
+        fatVerts.push_back(vtx);
+        // keep the load factor below 1/2
+        if (fatVerts.size() * 2 > slots.size())
+          Grow();
+        return (int)fatVerts.size() - 1;
+      }
 
-    vtx.meta.id = (int)fatVerts.size();
-    fatVertSet.insert(vtx);
-    fatVerts.push_back(vtx);
-    return vtx.meta.id;
+      if (slot.hash == hash && fatVerts[slot.idx] == vtx)
+        return slot.idx;
+    }
   }
 
-  const Vector* verts;
-  const CPolygon* polys;
-
-  bool hasNormalsTag;
-  bool hasPhongTag;
-  bool hasNormals;
+  void Grow()
+  {
+    vector<Slot> oldSlots(slots.size() * 2);
+    oldSlots.swap(slots);
+    u32 mask = (u32)slots.size() - 1;
+    for (const Slot& slot : oldSlots)
+    {
+      if (slot.idx == -1)
+        continue;
+      u32 i = slot.hash & mask;
+      while (slots[i].idx != -1)
+        i = (i + 1) & mask;
+      slots[i] = slot;
+    }
+  }
 
-  Vector32* phongNormals;
-  NormalTag* normals;
-  UVWTag* uvs;
-  ConstUVWHandle uvHandle;
-  ConstNormalHandle normalHandle;
+  const MeshSource& src;
 
-  unordered_set<FatVertex, FatVertex::Hash> fatVertSet;
+  // open addressing table with linear probing, indexing into fatVerts
+  struct Slot
+  {
+    u32 hash = 0;
+    int idx = -1;
+  };
+  vector<Slot> slots;
   vector<FatVertex> fatVerts;
 };
 
@@ -634,6 +639,58 @@ static void GroupPolysByMaterial(
   }
 }
 
+//-----------------------------------------------------------------------------
+static void CaptureMeshSource(PolygonObject* polyObj, MeshSource* src)
+{
+  int numVerts = polyObj->GetPointCount();
+  int numPolys = polyObj->GetPolygonCount();
+  src->verts.assign(polyObj->GetPointR(), polyObj->GetPointR() + numVerts);
+  src->polys.assign(polyObj->GetPolygonR(), polyObj->GetPolygonR() + numPolys);
+
+  if (NormalTag* normals = (NormalTag*)polyObj->GetTag(Tnormal))
+  {
+    ConstNormalHandle normalHandle = normals->GetDataAddressR();
+    src->normals.resize(numPolys * 4);
+    for (int i = 0; i < numPolys; ++i)
+    {
+      NormalStruct normal;
+      normals->Get(normalHandle, i, normal);
+      for (int j = 0; j < 4; ++j)
+        src->normals[i * 4 + j] = Vector3Coerce<Vector32>(AlphabetIndex<Vector>(normal, j));
+    }
+  }
+  else if (polyObj->GetTag(Tphong))
+  {
+    if (Vector32* phongNormals = polyObj->CreatePhongNormals())
+    {
+      src->normals.assign(phongNormals, phongNormals + numPolys * 4);
+      _MemFree((void**)&phongNormals);
+    }
+  }
+
+  if (UVWTag* uvs = (UVWTag*)polyObj->GetTag(Tuvw))
+  {
+    ConstUVWHandle uvHandle = uvs->GetDataAddressR();
+    src->uvs.resize(numPolys * 4);
+    for (int i = 0; i < numPolys; ++i)
+    {
+      UVWStruct uvw;
+      UVWTag::Get(uvHandle, i, uvw);
+      for (int j = 0; j < 4; ++j)
+        src->uvs[i * 4 + j] = Vector3Coerce<Vector32>(AlphabetIndex<Vector>(uvw, j));
+    }
+  }
+
+  // resolve the materials here, as the scene can't be touched from the worker threads
+  unordered_map<AlienMaterial*, vector<int>> polysByMaterial;
+  GroupPolysByMaterial(polyObj, &polysByMaterial);
+  for (pair<AlienMaterial* const, vector<int>>& kv : polysByMaterial)
+  {
+    ImMaterial* mat = g_ExportInstance.scene->FindMaterial(kv.first);
+    src->polysByMaterial.push_back(make_pair(mat ? mat->id : ~0, std::move(kv.second)));
+  }
+}
+
 //-----------------------------------------------------------------------------
 template <typename T>
 void CopyOutDataStream(const vector<T>& data, ImMesh::DataStream::Type type, ImMesh* mesh)
@@ -650,22 +707,192 @@ void CopyOutDataStream(const vector<T>& data, ImMesh::DataStream::Type type, ImM
 }
 
 //-----------------------------------------------------------------------------
-static void CollectVertices(
-    PolygonObject* polyObj, const unordered_map<AlienMaterial*, vector<int>>& polysByMaterial, ImMesh* mesh)
+static void CalcVertexCacheStats(const vector<int>& indices, int vertexCount, float* acmr, float* atvr)
+{
+  // simulate a fifo post transform cache. acmr is misses per triangle, and atvr is misses per vertex
+  vector<int> cacheTime(vertexCount, -MEASURE_FIFO_CACHE_SIZE - 1);
+  int misses = 0;
+  for (int idx : indices)
+  {
+    if (misses - cacheTime[idx] >= MEASURE_FIFO_CACHE_SIZE)
+    {
+      cacheTime[idx] = misses;
+      ++misses;
+    }
+  }
+
+  *acmr = indices.empty() ? 0 : misses / (indices.size() / 3.0f);
+  *atvr = vertexCount ? misses / (float)vertexCount : 0;
+}
+
+//-----------------------------------------------------------------------------
+static void OptimizeIndices(
+    const vector<ImMesh::MaterialGroup>& groups, int vertexCount, vector<int>* indices)
+{
+  // reorder the triangles in each material group for the vertex cache
+  vector<u32> src, dst;
+  for (const ImMesh::MaterialGroup& mg : groups)
+  {
+    src.assign(indices->begin() + mg.startIndex, indices->begin() + mg.startIndex + mg.indexCount);
+    dst.resize(src.size());
+    Forsyth::OptimizeFaces(src.data(), (u32)src.size(), vertexCount, dst.data(), OPTIMIZE_LRU_CACHE_SIZE);
+    copy(dst.begin(), dst.end(), indices->begin() + mg.startIndex);
+  }
+}
+
+//-----------------------------------------------------------------------------
+static void CalcFirstUseOrder(
+    const vector<int>& indices, int vertexCount, vector<int>* order, vector<int>* remap)
+{
+  // order[i] is the old index of the i'th new vertex, and remap[old] = new
+  remap->assign(vertexCount, -1);
+  order->clear();
+  order->reserve(vertexCount);
+  for (int idx : indices)
+  {
+    if ((*remap)[idx] == -1)
+    {
+      (*remap)[idx] = (int)order->size();
+      order->push_back(idx);
+    }
+  }
+}
+
+//-----------------------------------------------------------------------------
+static bool CompressIndexStream(
+    const vector<int>& indices, int vertexCount, vector<int>* vertexOrder, vector<char>* compressed)
+{
+  // the compressed indices refer to renumbered vertices, so vertexOrder is updated to match
+  vector<u32> src(indices.begin(), indices.end());
+  vector<u32> remap;
+  CompressIndices(src, vertexCount, compressed, &remap);
+
+#if WITH_INDEX_COMPRESSION_CHECK
+  if (!VerifyCompressedIndices(src, remap, *compressed))
+  {
+    compressed->clear();
+    return false;
+  }
+#endif
+
+  vector<int> newOrder(vertexCount);
+  for (int i = 0; i < vertexCount; ++i)
+    newOrder[remap[i]] = (*vertexOrder)[i];
+  *vertexOrder = newOrder;
+  return true;
+}
+
+//-----------------------------------------------------------------------------
+static void CreateLods(
+    const ExportInstance& instance, const FatVertexSupplier& fatVtx, vector<int>* indices, ImMesh* mesh)
+{
+  // each lod simplifies the material groups of the previous one to half the triangles, and appends
+  // the result to the index stream
+  vector<vec3> pos(fatVtx.fatVerts.size());
+  for (size_t i = 0; i < pos.size(); ++i)
+    pos[i] = vec3(fatVtx.fatVerts[i].pos);
+
+  vector<u32> src, dst;
+  const vector<ImMesh::MaterialGroup>* prevGroups = &mesh->materialGroups;
+  float prevError = 0;
+  mesh->lods.reserve(instance.options.lods);
+  for (int lodIdx = 0; lodIdx < instance.options.lods; ++lodIdx)
+  {
+    ImMesh::Lod lod;
+    lod.error = prevError;
+    for (const ImMesh::MaterialGroup& prev : *prevGroups)
+    {
+      src.assign(indices->begin() + prev.startIndex, indices->begin() + prev.startIndex + prev.indexCount);
+      int target = (int)prev.indexCount / 6 * 3;
+      float error = SimplifyIndices(pos, src.data(), (int)src.size(), target, &dst);
+      lod.error = max(lod.error, error);
+
+      ImMesh::MaterialGroup mg;
+      mg.materialId = prev.materialId;
+      mg.startIndex = (u32)indices->size();
+      mg.indexCount = (u32)dst.size();
+      indices->insert(indices->end(), dst.begin(), dst.end());
+      lod.materialGroups.push_back(mg);
+    }
+
+    int prevCount = 0, count = 0;
+    for (const ImMesh::MaterialGroup& mg : *prevGroups)
+      prevCount += mg.indexCount / 3;
+    for (const ImMesh::MaterialGroup& mg : lod.materialGroups)
+      count += mg.indexCount / 3;
+    instance.Log(2,
+        "lod %d: %s, %d -> %d triangles, error %f\n",
+        lodIdx + 1,
+        mesh->name.c_str(),
+        prevCount,
+        count,
+        lod.error);
+
+    prevError = lod.error;
+    mesh->lods.push_back(lod);
+    prevGroups = &mesh->lods.back().materialGroups;
+  }
+}
+
+//-----------------------------------------------------------------------------
+struct MeshletStreams
 {
-  int vertexCount = polyObj->GetPointCount();
+  vector<Meshlet> meshlets;
+  vector<u32> vertices;
+  vector<u8> triangles;
+  vector<MeshletBounds> bounds;
+};
+
+//-----------------------------------------------------------------------------
+static void CreateMeshlets(const FatVertexSupplier& fatVtx,
+    const vector<int>& indices,
+    const vector<int>& vertexOrder,
+    ImMesh* mesh,
+    MeshletStreams* out)
+{
+  // the meshlet vertices are fat vertex indices, and are remapped once the final vertex order is known
+  vector<vec3> pos(fatVtx.fatVerts.size());
+  for (size_t i = 0; i < pos.size(); ++i)
+    pos[i] = vec3(fatVtx.fatVerts[i].pos);
+
+  vector<u32> src;
+  for (const ImMesh::MaterialGroup& mg : mesh->materialGroups)
+  {
+    src.clear();
+    for (u32 i = mg.startIndex; i < mg.startIndex + mg.indexCount; ++i)
+      src.push_back(vertexOrder[indices[i]]);
+
+    ImMesh::MeshletGroup group;
+    group.materialId = mg.materialId;
+    group.startMeshlet = (u32)out->meshlets.size();
+    BuildMeshlets(
+        src.data(), (int)src.size(), (int)pos.size(), &out->meshlets, &out->vertices, &out->triangles);
+    group.meshletCount = (u32)out->meshlets.size() - group.startMeshlet;
+    mesh->meshletGroups.push_back(group);
+  }
+
+  out->bounds.reserve(out->meshlets.size());
+  for (const Meshlet& m : out->meshlets)
+    out->bounds.push_back(CalcMeshletBounds(m, out->vertices.data(), out->triangles.data(), pos.data()));
+}
+
+//-----------------------------------------------------------------------------
+static void CollectVertices(const ExportInstance& instance, const MeshSource& src)
+{
+  // nb, this runs on a worker thread, so it must only use the instance that's passed in
+  ImMesh* mesh = src.mesh;
+  int vertexCount = (int)src.verts.size();
   if (!vertexCount)
   {
     // TODO: log
     return;
   }
 
-  const Vector* verts = polyObj->GetPointR();
-  const CPolygon* polys = polyObj->GetPolygonR();
+  const CPolygon* polys = src.polys.data();
 
-  CalcBoundingVolumes(verts, vertexCount, &mesh->boundingSphere, &mesh->aabb);
+  CalcBoundingVolumes(src.verts.data(), vertexCount, &mesh->boundingSphere, &mesh->aabb);
 
-  FatVertexSupplier fatVtx(polyObj);
+  FatVertexSupplier fatVtx(src);
   int startIdx = 0;
 
   vector<int> indexStream;
@@ -673,11 +900,10 @@ static void CollectVertices(
   int maxVtx = 0;
 
   // Create the material groups, where each group contains polygons that share the same material
-  for (const pair<AlienMaterial*, vector<int>>& kv : polysByMaterial)
+  for (const pair<int, vector<int>>& kv : src.polysByMaterial)
   {
     ImMesh::MaterialGroup mg;
-    ImMaterial* mat = g_ExportInstance.scene->FindMaterial(kv.first);
-    mg.materialId = mat ? mat->id : ~0;
+    mg.materialId = kv.first;
     mg.startIndex = startIdx;
 
     // iterate over all the polygons in the material group, and collect the vertices
@@ -711,24 +937,91 @@ static void CollectVertices(
     mesh->materialGroups.push_back(mg);
   }
 
-  // copy the data over from the fat vertices
   int numFatVerts = (int)fatVtx.fatVerts.size();
 
+  if (instance.options.lods > 0)
+    CreateLods(instance, fatVtx, &indexStream, mesh);
+
+  // the order the fat vertices are written out in
+  vector<int> vertexOrder(numFatVerts);
+  for (int i = 0; i < numFatVerts; ++i)
+    vertexOrder[i] = i;
+
+  if (instance.options.optimizeIndices)
+  {
+    float acmrBefore, atvrBefore, acmrAfter, atvrAfter;
+    CalcVertexCacheStats(indexStream, numFatVerts, &acmrBefore, &atvrBefore);
+    OptimizeIndices(mesh->materialGroups, numFatVerts, &indexStream);
+    for (const ImMesh::Lod& lod : mesh->lods)
+      OptimizeIndices(lod.materialGroups, numFatVerts, &indexStream);
+
+    // remap the vertices into first use order, so they are fetched linearly
+    vector<int> remap;
+    CalcFirstUseOrder(indexStream, numFatVerts, &vertexOrder, &remap);
+    for (int& idx : indexStream)
+      idx = remap[idx];
+
+    CalcVertexCacheStats(indexStream, numFatVerts, &acmrAfter, &atvrAfter);
+    instance.Log(2,
+        "optimize indices: %s, acmr %.3f -> %.3f, atvr %.3f -> %.3f\n",
+        mesh->name.c_str(),
+        acmrBefore,
+        acmrAfter,
+        atvrBefore,
+        atvrAfter);
+  }
+
+  MeshletStreams meshlets;
+  if (instance.options.meshlets)
+  {
+    CreateMeshlets(fatVtx, indexStream, vertexOrder, mesh, &meshlets);
+    instance.Log(2,
+        "meshlets: %s, %d meshlets for %d triangles\n",
+        mesh->name.c_str(),
+        (int)meshlets.meshlets.size(),
+        (int)meshlets.triangles.size() / 3);
+  }
+
+  vector<char> compressedIndices;
+  if (instance.options.compressIndices)
+  {
+    if (CompressIndexStream(indexStream, numFatVerts, &vertexOrder, &compressedIndices))
+    {
+      instance.Log(2,
+          "compress indices: %s, %d -> %d bytes\n",
+          mesh->name.c_str(),
+          (int)indexStream.size() * (maxVtx < 65536 ? 2 : 4),
+          (int)compressedIndices.size());
+    }
+    else
+    {
+      instance.Log(1,
+          "Index compression round trip failed for mesh: %s, writing uncompressed indices\n",
+          mesh->name.c_str());
+    }
+  }
+
+  // copy the data over from the fat vertices
   vector<Vector32> posStream;
   vector<Vector32> normalStream;
   vector<vec2> uvStream;
+  bool hasUvs = !fatVtx.src.uvs.empty();
 
-  for (int i = 0; i < numFatVerts; ++i)
+  for (int i : vertexOrder)
   {
     posStream.push_back(fatVtx.fatVerts[i].pos);
     normalStream.push_back(fatVtx.fatVerts[i].normal);
-    if (fatVtx.uvHandle)
+    if (hasUvs)
     {
       uvStream.push_back(vec2{fatVtx.fatVerts[i].uv.x, fatVtx.fatVerts[i].uv.y});
     }
   }
 
-  if (maxVtx < 65536)
+  if (!compressedIndices.empty())
+  {
+    CopyOutDataStream(compressedIndices, ImMesh::DataStream::Type::IndexCompressed, mesh);
+  }
+  else if (maxVtx < 65536)
   {
     vector<u16> indexStream16(indexStream.size());
     for (size_t i = 0; i < indexStream.size(); ++i)
@@ -741,6 +1034,41 @@ static void CollectVertices(
   {
     CopyOutDataStream(indexStream, ImMesh::DataStream::Type::Index32, mesh);
   }
+
+  if (instance.options.meshlets)
+  {
+    vector<int> finalIdx(numFatVerts);
+    for (size_t i = 0; i < vertexOrder.size(); ++i)
+      finalIdx[vertexOrder[i]] = (int)i;
+    for (u32& v : meshlets.vertices)
+      v = finalIdx[v];
+
+    CopyOutDataStream(meshlets.meshlets, ImMesh::DataStream::Type::Meshlet, mesh);
+    CopyOutDataStream(meshlets.vertices, ImMesh::DataStream::Type::MeshletVertex, mesh);
+    CopyOutDataStream(meshlets.triangles, ImMesh::DataStream::Type::MeshletTriangle, mesh);
+    CopyOutDataStream(meshlets.bounds, ImMesh::DataStream::Type::MeshletBounds, mesh);
+  }
+
+  if (instance.options.compressVertices)
+  {
+    vector<u16> pos16;
+    vector<s16> normalOct;
+    QuantizePositions(
+        (const float*)posStream.data(), numFatVerts, mesh->aabb.minValue, mesh->aabb.maxValue, &pos16);
+    EncodeNormalsOct((const float*)normalStream.data(), numFatVerts, &normalOct);
+    CopyOutDataStream(pos16, ImMesh::DataStream::Type::PosQuantized16, mesh);
+    CopyOutDataStream(normalOct, ImMesh::DataStream::Type::NormalOct16, mesh);
+
+    if (uvStream.size())
+    {
+      vector<u16> uv16;
+      bool unorm = EncodeUVs((const float*)uvStream.data(), numFatVerts, &uv16);
+      CopyOutDataStream(
+          uv16, unorm ? ImMesh::DataStream::Type::UVUnorm16 : ImMesh::DataStream::Type::UVHalf, mesh);
+    }
+    return;
+  }
+
   CopyOutDataStream(posStream, ImMesh::DataStream::Type::Pos, mesh);
   CopyOutDataStream(normalStream, ImMesh::DataStream::Type::Normal, mesh);
 
@@ -751,52 +1079,59 @@ static void CollectVertices(
 }
 
 //-----------------------------------------------------------------------------
-void CreateGeometry(PolygonObject* polyObj, ImMesh* mesh)
+static void CreateGeometry(const MeshSource& src)
 {
-  const CPolygon* polygons = polyObj->GetPolygonR();
-  const Vector* verts = polyObj->GetPointR();
+  ImMesh* mesh = src.mesh;
+  const CPolygon* polygons = src.polys.data();
+  const Vector* verts = src.verts.data();
+  int numVerts = (int)src.verts.size();
+  int numPolys = (int)src.polys.size();
 
   // copy over the vertices
-  mesh->geometry.vertices.resize(polyObj->GetPointCount());
-  for (int i = 0; i < polyObj->GetPointCount(); ++i)
+  mesh->geometry.vertices.resize(numVerts);
+  for (int i = 0; i < numVerts; ++i)
   {
     // transform vertex to world space
     Vector v = mesh->xformGlobal.mtx * verts[i];
     vec3 vv{(float)v.x, (float)v.y, (float)v.z};
-    mesh->geometry.aabb.minValue = Min(mesh->aabb.minValue, vv);
-    mesh->geometry.aabb.maxValue = Max(mesh->aabb.maxValue, vv);
+    mesh->geometry.aabb.minValue = Min(mesh->geometry.aabb.minValue, vv);
+    mesh->geometry.aabb.maxValue = Max(mesh->geometry.aabb.maxValue, vv);
     mesh->geometry.vertices[i] = ImMeshVertex{vv.x, vv.y, vv.z};
   }
 
-  // keep track of which polygons each vertex and edge is a part of
-  unordered_map<int, vector<int>> vertexToFace;
-  unordered_map<pair<int, int>, vector<int>> edgeToPolys;
-
   auto CalcFaceNormal = [=](int a, int b, int c) {
     vec3 e0 = verts[b] - verts[a];
     vec3 e1 = verts[c] - verts[a];
     return Normalize(Cross(e0, e1));
   };
 
-  auto MakeEdgeKey = [](int a, int b) { return make_pair(min(a, b), max(a, b)); };
+  // edges are keyed on (min vertex, max vertex), packed so they sort by min then max
+  auto MakeEdgeKey = [](int a, int b) { return ((u64)(u32)min(a, b) << 32) | (u32)max(a, b); };
+
+  // keep track of which faces each vertex and edge is a part of. the vertex faces are collected as
+  // (vertex, face) pairs, and the edge faces as (edge, face edge slot) pairs, both in face order
+  vector<pair<int, int>> vertexFaces;
+  vector<pair<u64, int>> edgeFaces;
+  vertexFaces.reserve(numPolys * 4);
+  edgeFaces.reserve(numPolys * 6);
 
   // iterate the polygons, triangulate quads, and save faces/face normals
-  mesh->geometry.faces.reserve(polyObj->GetPolygonCount() * 2);
-  mesh->geometry.faceNormals.reserve(polyObj->GetPolygonCount() * 2);
+  mesh->geometry.faces.reserve(numPolys * 2);
+  mesh->geometry.faceNormals.reserve(numPolys * 2);
   int faceIdx = 0;
-  for (int i = 0; i < polyObj->GetPolygonCount(); ++i)
+  for (int i = 0; i < numPolys; ++i)
   {
     const CPolygon& poly = polygons[i];
     mesh->geometry.faces.push_back(ImMeshFace{poly.a, poly.b, poly.c});
     mesh->geometry.faceNormals.push_back(CalcFaceNormal(poly.a, poly.b, poly.c));
 
-    vertexToFace[poly.a].push_back(faceIdx);
-    vertexToFace[poly.b].push_back(faceIdx);
-    vertexToFace[poly.c].push_back(faceIdx);
+    vertexFaces.push_back(make_pair(poly.a, faceIdx));
+    vertexFaces.push_back(make_pair(poly.b, faceIdx));
+    vertexFaces.push_back(make_pair(poly.c, faceIdx));
 
-    edgeToPolys[MakeEdgeKey(poly.a, poly.b)].push_back(faceIdx);
-    edgeToPolys[MakeEdgeKey(poly.a, poly.c)].push_back(faceIdx);
-    edgeToPolys[MakeEdgeKey(poly.b, poly.c)].push_back(faceIdx);
+    edgeFaces.push_back(make_pair(MakeEdgeKey(poly.a, poly.b), faceIdx * 3 + 0));
+    edgeFaces.push_back(make_pair(MakeEdgeKey(poly.a, poly.c), faceIdx * 3 + 1));
+    edgeFaces.push_back(make_pair(MakeEdgeKey(poly.b, poly.c), faceIdx * 3 + 2));
 
     faceIdx++;
 
@@ -806,45 +1141,71 @@ void CreateGeometry(PolygonObject* polyObj, ImMesh* mesh)
       mesh->geometry.faces.push_back(ImMeshFace{poly.a, poly.c, poly.d});
       mesh->geometry.faceNormals.push_back(CalcFaceNormal(poly.a, poly.c, poly.d));
 
-      vertexToFace[poly.d].push_back(faceIdx);
+      vertexFaces.push_back(make_pair(poly.d, faceIdx));
 
-      edgeToPolys[MakeEdgeKey(poly.a, poly.c)].push_back(faceIdx);
-      edgeToPolys[MakeEdgeKey(poly.a, poly.d)].push_back(faceIdx);
-      edgeToPolys[MakeEdgeKey(poly.c, poly.d)].push_back(faceIdx);
+      edgeFaces.push_back(make_pair(MakeEdgeKey(poly.a, poly.c), faceIdx * 3 + 0));
+      edgeFaces.push_back(make_pair(MakeEdgeKey(poly.a, poly.d), faceIdx * 3 + 1));
+      edgeFaces.push_back(make_pair(MakeEdgeKey(poly.c, poly.d), faceIdx * 3 + 2));
 
       faceIdx++;
     }
   }
 
+  const vector<vec3>& faceNormals = mesh->geometry.faceNormals;
+
+  // counting sort the vertex faces into CSR form, where the faces for vertex i are in
+  // vertexToFace[vertexOffsets[i]..vertexOffsets[i+1]), still in face order
+  vector<int> vertexOffsets(numVerts + 1, 0);
+  for (const pair<int, int>& vf : vertexFaces)
+    vertexOffsets[vf.first + 1]++;
+  for (int i = 0; i < numVerts; ++i)
+    vertexOffsets[i + 1] += vertexOffsets[i];
+
+  vector<int> vertexToFace(vertexFaces.size());
+  {
+    vector<int> cursor(vertexOffsets.begin(), vertexOffsets.end() - 1);
+    for (const pair<int, int>& vf : vertexFaces)
+      vertexToFace[cursor[vf.first]++] = vf.second;
+  }
+
   // create vertex normals
   // nb, right now this is just standard gouraud. later i want to do angle weighted
   mesh->geometry.vertexNormals.resize(mesh->geometry.vertices.size());
-  for (const auto& kv : vertexToFace)
+  for (int vtx = 0; vtx < numVerts; ++vtx)
   {
-    int vtx = kv.first;
-    const vector<int>& faces = kv.second;
+    if (vertexOffsets[vtx] == vertexOffsets[vtx + 1])
+    {
+      // unreferenced vertex
+      mesh->geometry.vertexNormals[vtx] = vec3{0, 0, 0};
+      continue;
+    }
 
     vec3 n{0, 0, 0};
-    for (size_t i = 0; i < faces.size(); ++i)
+    for (int i = vertexOffsets[vtx]; i < vertexOffsets[vtx + 1]; ++i)
     {
-      n += mesh->geometry.faceNormals[faces[i]];
+      n += faceNormals[vertexToFace[i]];
     }
 
     mesh->geometry.vertexNormals[vtx] = Normalize(n);
   }
 
-  // create edge normals
-  for (const auto& kv : edgeToPolys)
+  // create edge normals, and store them in every face edge slot that uses the edge. sorting groups the
+  // faces for each edge, and keeps them in face order
+  sort(edgeFaces.begin(), edgeFaces.end());
+  mesh->geometry.edgeNormals.resize(faceIdx * 3);
+  for (size_t i = 0; i < edgeFaces.size();)
   {
-    pair<int, int> edge = kv.first;
-    const vector<int>& faces = kv.second;
-
+    size_t first = i;
+    u64 key = edgeFaces[i].first;
     vec3 n{0, 0, 0};
-    for (size_t i = 0; i < faces.size(); ++i)
+    for (; i < edgeFaces.size() && edgeFaces[i].first == key; ++i)
     {
-      n += mesh->geometry.faceNormals[faces[i]];
+      n += faceNormals[edgeFaces[i].second / 3];
     }
-    mesh->geometry.edgeNormals[edge] = Normalize(n);
+
+    n = Normalize(n);
+    for (size_t j = first; j < i; ++j)
+      mesh->geometry.edgeNormals[edgeFaces[j].second] = n;
   }
 }
 
@@ -858,15 +1219,151 @@ bool AlienPolygonObjectData::Execute()
   if (!mesh->valid)
     return false;
 
-  unordered_map<AlienMaterial*, vector<int>> polysByMaterial;
-  GroupPolysByMaterial(polyObj, &polysByMaterial);
-  CollectVertices(polyObj, polysByMaterial, mesh.get());
-
   CopyBaseTransform(baseObj, mesh.get());
-  CreateGeometry(polyObj, mesh.get());
-  g_ExportInstance.scene->boundingBox = g_ExportInstance.scene->boundingBox.Extend(mesh->geometry.aabb);
+
+  // capture the raw data, and leave building the mesh to BuildPendingMeshes
+  shared_ptr<MeshSource> src = std::make_shared<MeshSource>();
+  src->mesh = mesh.get();
+  CaptureMeshSource(polyObj, src.get());
+  g_ExportInstance.pendingMeshes.push_back(src);
 
   g_ExportInstance.scene->meshes.push_back(mesh.release());
 
   return true;
 }
+
+//-----------------------------------------------------------------------------
+static u64 MeshDataHash(const ImMesh& mesh)
+{
+  // hash everything that ExportMeshData writes
+  u64 hash = FnvHash64(nullptr, 0);
+  auto fnHash = [&hash](const void* data, size_t len) { hash = FnvHash64(data, len, hash); };
+  auto fnHashGroups = [&](const vector<ImMesh::MaterialGroup>& groups) {
+    fnHash(groups.data(), groups.size() * sizeof(ImMesh::MaterialGroup));
+  };
+
+  for (const ImMesh::DataStream& s : mesh.dataStreams)
+  {
+    fnHash(&s.type, sizeof(s.type));
+    fnHash(&s.flags, sizeof(s.flags));
+    fnHash(s.data.data(), s.data.size());
+  }
+  fnHashGroups(mesh.materialGroups);
+  for (const ImMesh::Lod& lod : mesh.lods)
+  {
+    fnHash(&lod.error, sizeof(lod.error));
+    fnHashGroups(lod.materialGroups);
+  }
+  fnHash(mesh.meshletGroups.data(), mesh.meshletGroups.size() * sizeof(ImMesh::MeshletGroup));
+  // compressed positions are dequantized with the mesh's own aabb, so identical bytes aren't enough
+  fnHash(&mesh.aabb.minValue, sizeof(mesh.aabb.minValue));
+  fnHash(&mesh.aabb.maxValue, sizeof(mesh.aabb.maxValue));
+  return hash;
+}
+
+//-----------------------------------------------------------------------------
+static bool SameMeshData(const ImMesh& a, const ImMesh& b)
+{
+  auto fnSameGroups = [](const vector<ImMesh::MaterialGroup>& lhs, const vector<ImMesh::MaterialGroup>& rhs) {
+    return lhs.size() == rhs.size()
+           && memcmp(lhs.data(), rhs.data(), lhs.size() * sizeof(ImMesh::MaterialGroup)) == 0;
+  };
+
+  auto fnSameVec = [](const vec3& lhs, const vec3& rhs) {
+    return lhs.x == rhs.x && lhs.y == rhs.y && lhs.z == rhs.z;
+  };
+
+  if (a.dataStreams.size() != b.dataStreams.size() || a.lods.size() != b.lods.size()
+      || a.meshletGroups.size() != b.meshletGroups.size()
+      || !fnSameGroups(a.materialGroups, b.materialGroups))
+    return false;
+
+  if (!fnSameVec(a.aabb.minValue, b.aabb.minValue) || !fnSameVec(a.aabb.maxValue, b.aabb.maxValue))
+    return false;
+
+  for (size_t i = 0; i < a.dataStreams.size(); ++i)
+  {
+    const ImMesh::DataStream& sa = a.dataStreams[i];
+    const ImMesh::DataStream& sb = b.dataStreams[i];
+    if (sa.type != sb.type || sa.flags != sb.flags || sa.data != sb.data)
+      return false;
+  }
+
+  for (size_t i = 0; i < a.lods.size(); ++i)
+  {
+    const ImMesh::Lod& la = a.lods[i];
+    const ImMesh::Lod& lb = b.lods[i];
+    if (la.error != lb.error || !fnSameGroups(la.materialGroups, lb.materialGroups))
+      return false;
+  }
+
+  return memcmp(a.meshletGroups.data(),
+             b.meshletGroups.data(),
+             a.meshletGroups.size() * sizeof(ImMesh::MeshletGroup))
+         == 0;
+}
+
+//-----------------------------------------------------------------------------
+static void AssignGeometryIds(const ExportInstance& instance)
+{
+  // meshes with identical data share a single geometry, and only differ in their transforms. the
+  // hash only finds the candidates, and the data is compared before it's shared
+  ImScene* scene = instance.scene;
+  vector<u64> hashes(scene->meshes.size());
+  ParallelFor((int)scene->meshes.size(), NumWorkerThreads(instance.options.threads), [&](int idx) {
+    hashes[idx] = MeshDataHash(*scene->meshes[idx]);
+  });
+
+  unordered_map<u64, vector<ImMesh*>> geometriesByHash;
+  size_t sharedBytes = 0;
+  for (size_t i = 0; i < scene->meshes.size(); ++i)
+  {
+    ImMesh* mesh = scene->meshes[i];
+    vector<ImMesh*>& candidates = geometriesByHash[hashes[i]];
+    auto it = find_if(candidates.begin(), candidates.end(), [=](const ImMesh* g) {
+      return SameMeshData(*g, *mesh);
+    });
+
+    if (it != candidates.end())
+    {
+      mesh->geometryId = (*it)->geometryId;
+      for (const ImMesh::DataStream& s : mesh->dataStreams)
+        sharedBytes += s.data.size();
+      continue;
+    }
+
+    mesh->geometryId = (u32)scene->geometries.size();
+    scene->geometries.push_back(mesh);
+    candidates.push_back(mesh);
+  }
+
+  instance.Log(2,
+      "mesh instancing: %d meshes, %d geometries, %.2f kb shared\n",
+      (int)scene->meshes.size(),
+      (int)scene->geometries.size(),
+      sharedBytes / 1024.0f);
+}
+
+//-----------------------------------------------------------------------------
+void BuildPendingMeshes()
+{
+  vector<shared_ptr<MeshSource>> pending;
+  pending.swap(g_ExportInstance.pendingMeshes);
+
+  // the worker threads have their own (empty) g_ExportInstance, so they get the current one passed in
+  const ExportInstance& instance = g_ExportInstance;
+  int numThreads = NumWorkerThreads(instance.options.threads);
+  ParallelFor((int)pending.size(), numThreads, [&](int idx) {
+    const MeshSource& src = *pending[idx];
+    CollectVertices(instance, src);
+    CreateGeometry(src);
+  });
+
+  for (const shared_ptr<MeshSource>& src : pending)
+  {
+    g_ExportInstance.scene->boundingBox =
+        g_ExportInstance.scene->boundingBox.Extend(src->mesh->geometry.aabb);
+  }
+
+  AssignGeometryIds(instance);
+}
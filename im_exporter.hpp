@@ -50,3 +50,6 @@ namespace melange
     virtual Bool Execute();
   };
 }
+
+// Builds the meshes captured by AlienPolygonObjectData::Execute, one task per mesh
+void BuildPendingMeshes();
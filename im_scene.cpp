@@ -2,7 +2,7 @@
 #include "exporter.hpp"
 #include "exporter_utils.hpp"
 
-extern ExportInstance g_ExportInstance;
+extern thread_local ExportInstance g_ExportInstance;
 
 //-----------------------------------------------------------------------------
 ImScene::~ImScene()
@@ -15,7 +15,7 @@ ImBaseObject::ImBaseObject(melange::BaseObject* melangeObj)
   : melangeObj(melangeObj)
   , parent(g_ExportInstance.scene->FindObject(melangeObj->GetUp()))
   , name(CopyString(melangeObj->GetName()))
-  , id(ImScene::nextObjectId++)
+  , id(g_ExportInstance.scene->nextObjectId++)
 {
   g_ExportInstance.Log(1, "Exporting: %s\n", name.c_str());
   melange::BaseObject* melangeParent = melangeObj->GetUp();
@@ -39,6 +39,11 @@ ImBaseObject::ImBaseObject(melange::BaseObject* melangeObj)
   g_ExportInstance.scene->imObjectToMelange[this] = melangeObj;
 }
 
+//-----------------------------------------------------------------------------
+ImMaterial::ImMaterial() : mat(nullptr), id(g_ExportInstance.scene->nextMaterialId++)
+{
+}
+
 //------------------------------------------------------------------------------
 const ImMesh::DataStream* ImMesh::StreamByType(ImMesh::DataStream::Type type) const
 {
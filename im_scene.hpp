@@ -52,7 +52,9 @@ struct ImGeometry
   vector<ImMeshFace> faces;
   vector<ImMeshVertex> vertices;
   vector<vec3> faceNormals;
-  unordered_map<pair<int, int>, vec3> edgeNormals;
+  // 3 per face, indexed by faceIdx * 3 + edge, where the edges are ab, ac and bc (the TriangleFeature
+  // edge order). shared edges have the same normal in every face that uses them
+  vector<vec3> edgeNormals;
   vector<vec3> vertexNormals;
   ImAABB aabb;
 };
@@ -62,12 +64,21 @@ struct ImKeyframe
 {
   int frame;
   float value;
+  // slope in value per frame, for hermite curves
+  float tangent;
 };
 
 //------------------------------------------------------------------------------
 struct ImCurve
 {
+  enum class Interpolation
+  {
+    Linear,
+    Hermite,
+  };
+
   string name;
+  Interpolation interpolation = Interpolation::Linear;
   vector<ImKeyframe> keyframes;
 };
 
@@ -95,6 +106,27 @@ struct ImTransform
   vec3 scale;
 };
 
+//------------------------------------------------------------------------------
+struct ImBakedTransforms
+{
+  // one sample per frame, starting at startFrame
+  bool IsConstant() const
+  {
+    for (size_t i = 1; i < pos.size(); ++i)
+    {
+      if (memcmp(&pos[i], &pos[0], sizeof(vec3)) || memcmp(&quat[i], &quat[0], sizeof(Vec4))
+          || memcmp(&scale[i], &scale[0], sizeof(vec3)))
+        return false;
+    }
+    return true;
+  }
+
+  int startFrame = 0;
+  vector<vec3> pos;
+  vector<Vec4> quat;
+  vector<vec3> scale;
+};
+
 //------------------------------------------------------------------------------
 struct ImBaseObject
 {
@@ -112,6 +144,8 @@ struct ImBaseObject
 
   vector<ImSampledTrack> sampledAnimTracks;
   vector<ImTrack> animTracks;
+  // the global transform for every frame, empty if the object doesn't move. see SampleGlobalTransforms
+  ImBakedTransforms bakedXformGlobal;
   vector<ImBaseObject*> children;
 };
 
@@ -191,15 +225,13 @@ struct ImMaterialComponent
 //------------------------------------------------------------------------------
 struct ImMaterial
 {
-  ImMaterial() : mat(nullptr), id(nextId++) {}
+  ImMaterial();
 
   string name;
   melange::BaseMaterial* mat;
   u32 id;
 
   vector<ImMaterialComponent> components;
-
-  static u32 nextId;
 };
 
 //------------------------------------------------------------------------------
@@ -229,9 +261,21 @@ struct ImMesh : public ImBaseObject
     {
       Index16,
       Index32,
+      // compressed with CompressIndexBuffer, see mesh_compress.hpp
+      IndexCompressed,
       Pos,
       Normal,
       UV,
+      // the compressed vertex streams, see mesh_compress.hpp
+      PosQuantized16,
+      NormalOct16,
+      UVUnorm16,
+      UVHalf,
+      // the meshlet streams, see mesh_meshlets.hpp
+      Meshlet,
+      MeshletVertex,
+      MeshletTriangle,
+      MeshletBounds,
     };
 
     size_t NumElems() const { return data.size() / elemSize; }
@@ -249,6 +293,30 @@ struct ImMesh : public ImBaseObject
   vector<MaterialGroup> materialGroups;
   vector<u32> selectedEdges;
 
+  // simplified versions of the mesh, using the same vertices. their index ranges follow the full
+  // detail ranges in the index stream
+  struct Lod
+  {
+    // sqrt of the largest quadric error of the collapses that built this lod and the ones before it,
+    // ie the rms object space distance of a moved vertex to its original planes. it's an estimate to
+    // pick lods with, not a bound on the distance between the surfaces
+    float error = 0;
+    vector<MaterialGroup> materialGroups;
+  };
+  vector<Lod> lods;
+
+  // the meshlets for each material group, as a range in the meshlet streams
+  struct MeshletGroup
+  {
+    int materialId;
+    u32 startMeshlet;
+    u32 meshletCount;
+  };
+  vector<MeshletGroup> meshletGroups;
+
+  // index into ImScene::geometries of the mesh whose data this mesh shares, which can be this mesh
+  u32 geometryId = ~0u;
+
   ImSphere boundingSphere;
   ImAABB aabb;
   ImGeometry geometry ;
@@ -263,6 +331,8 @@ struct ImScene
   ImMaterial* FindMaterial(melange::BaseMaterial* mat);
   vector<ImPrimitive*> primitives;
   vector<ImMesh*> meshes;
+  // the meshes with unique data, in geometryId order. these are also in meshes, which owns them
+  vector<ImMesh*> geometries;
   vector<ImCamera*> cameras;
   vector<ImNullObject*> nullObjects;
   vector<ImLight*> lights;
@@ -277,5 +347,6 @@ struct ImScene
   float startTime, endTime;
   int fps;
 
-  static u32 nextObjectId;
+  u32 nextObjectId = 1;
+  u32 nextMaterialId = 0;
 };
@@ -3,9 +3,9 @@
 #include "exporter_utils.hpp"
 #include "sdf_gen.hpp"
 #include "bit_utils.hpp"
-
-static unordered_map<ImBaseObject*, string> _objectToNodeName;
-vector<char> buffer;
+#include "mesh_compress.hpp"
+#include "mesh_meshlets.hpp"
+#include "compress/indexbuffercompressionformat.h"
 
 struct StreamData
 {
@@ -17,17 +17,35 @@ struct StreamData
 static unordered_map<ImMesh::DataStream::Type, StreamData> streamToStreamData = {
     {ImMesh::DataStream::Type::Index16, StreamData{"u16", "scalar", 2}},
     {ImMesh::DataStream::Type::Index32, StreamData{"u32", "scalar", 4}},
+    {ImMesh::DataStream::Type::IndexCompressed, StreamData{"u8", "compressed", 1}},
     {ImMesh::DataStream::Type::Pos, StreamData{"r32", "vec3", 12}},
     {ImMesh::DataStream::Type::Normal, StreamData{"r32", "vec3", 12}},
     {ImMesh::DataStream::Type::UV, StreamData{"r32", "vec2", 8}},
+    {ImMesh::DataStream::Type::PosQuantized16, StreamData{"u16", "vec3", 6}},
+    {ImMesh::DataStream::Type::NormalOct16, StreamData{"s16", "oct", 4}},
+    {ImMesh::DataStream::Type::UVUnorm16, StreamData{"u16", "vec2", 4}},
+    {ImMesh::DataStream::Type::UVHalf, StreamData{"r16", "vec2", 4}},
+    {ImMesh::DataStream::Type::Meshlet, StreamData{"u32", "meshlet", 16}},
+    {ImMesh::DataStream::Type::MeshletVertex, StreamData{"u32", "scalar", 4}},
+    {ImMesh::DataStream::Type::MeshletTriangle, StreamData{"u8", "vec3", 3}},
+    {ImMesh::DataStream::Type::MeshletBounds, StreamData{"r32", "meshletBounds", 44}},
 };
 
 static unordered_map<ImMesh::DataStream::Type, string> streamTypeToString = {
     {ImMesh::DataStream::Type::Index16, "index"},
     {ImMesh::DataStream::Type::Index32, "index"},
+    {ImMesh::DataStream::Type::IndexCompressed, "index"},
     {ImMesh::DataStream::Type::Pos, "pos"},
     {ImMesh::DataStream::Type::Normal, "normal"},
     {ImMesh::DataStream::Type::UV, "uv"},
+    {ImMesh::DataStream::Type::PosQuantized16, "pos"},
+    {ImMesh::DataStream::Type::NormalOct16, "normal"},
+    {ImMesh::DataStream::Type::UVUnorm16, "uv"},
+    {ImMesh::DataStream::Type::UVHalf, "uv"},
+    {ImMesh::DataStream::Type::Meshlet, "meshlets"},
+    {ImMesh::DataStream::Type::MeshletVertex, "meshletVertices"},
+    {ImMesh::DataStream::Type::MeshletTriangle, "meshletTriangles"},
+    {ImMesh::DataStream::Type::MeshletBounds, "meshletBounds"},
 };
 
 static unordered_map<ImLight::Type, string> lightTypeToString = {
@@ -37,13 +55,80 @@ static unordered_map<ImLight::Type, string> lightTypeToString = {
     {ImLight::Type::Area, "area"},
 };
 
+// max error of the quantized animation tracks, relative to the range of each track
+static const float ANIM_TRACK_MAX_ERROR = 0.0001f;
+
 //------------------------------------------------------------------------------
-void JsonExporter::AddToBuffer(const char* data, size_t len, const string& name, JsonWriter* w)
+static u32 AnimTrackBits(float maxError)
+{
+  // values are rounded to the nearest multiple of 1/m, with m = 2^(numBits - 1), so the error is at most
+  // 0.5/m. the smallest numBits where that's within maxError is found without looking at the values
+  int numBits = 1 + (int)ceilf(log2f(0.5f / maxError));
+  if ((0.5f / (1 << (numBits - 1))) > maxError)
+    ++numBits;
+  return (u32)min(max(numBits, 8), 31);
+}
+
+//------------------------------------------------------------------------------
+static void QuantizeTrack(
+    const vector<float>& values, float minValue, float scale, u32 maxQ, vector<u32>* out)
+{
+  // q = round((v - minValue) * scale), clamped to [0, maxQ]. 4 values at a time, and the tail with the
+  // same rounding
+  size_t n = values.size();
+  out->resize(n);
+  u32* dst = out->data();
+
+  __m128 vMin = _mm_set1_ps(minValue);
+  __m128 vScale = _mm_set1_ps(scale);
+  __m128 vZero = _mm_setzero_ps();
+  __m128 vMaxQ = _mm_set1_ps((float)maxQ);
+
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4)
+  {
+    __m128 v = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(&values[i]), vMin), vScale);
+    v = _mm_min_ps(_mm_max_ps(v, vZero), vMaxQ);
+    _mm_storeu_si128((__m128i*)&dst[i], _mm_cvtps_epi32(v));
+  }
+
+  for (; i < n; ++i)
+  {
+    __m128 v = _mm_mul_ss(_mm_sub_ss(_mm_set_ss(values[i]), vMin), vScale);
+    v = _mm_min_ss(_mm_max_ss(v, vZero), vMaxQ);
+    dst[i] = (u32)_mm_cvtss_si32(v);
+  }
+}
+
+//------------------------------------------------------------------------------
+void JsonExporter::AddToBuffer(
+    const char* data, size_t len, const string& name, DatSectionType type, JsonWriter* w)
 {
   JsonWriter::JsonScope s(w, name, JsonWriter::CompoundType::Object);
-  w->Emit("offset", buffer.size());
+
+  if (!dat.IsOpen() && !datOpenFailed)
+  {
+    string filename = instance->options.outputPrefix + ".dat";
+    datOpenFailed = !dat.Open(filename);
+    if (datOpenFailed)
+      instance->Log(1, "Unable to open data file: %s\n", filename.c_str());
+  }
+
+  if (datOpenFailed)
+    return;
+
+  // repeated blobs point at the first copy
+  bool deduped;
+  int idx = dat.AddSection(data, len, type, &deduped);
+  if (deduped)
+  {
+    dedupedSize += len;
+    dedupedBlobs++;
+  }
+
+  w->Emit("section", idx);
+  w->Emit("offset", dat.Section(idx).offset);
   w->Emit("size", len);
-  buffer.insert(buffer.end(), data, data + len);
 }
 
 //------------------------------------------------------------------------------
@@ -63,6 +148,19 @@ void JsonExporter::ExportBase(ImBaseObject* obj, JsonWriter* w)
   fnWriteXform("xformLocal", obj->xformLocal);
   fnWriteXform("xformGlobal", obj->xformGlobal);
 
+  const ImBakedTransforms& baked = obj->bakedXformGlobal;
+  if (!baked.pos.empty())
+  {
+    // world space transform per frame, in the same form as xformGlobal
+    JsonWriter::JsonScope s(w, "bakedXformGlobal", JsonWriter::CompoundType::Object);
+    w->Emit("fps", instance->scene->fps);
+    w->Emit("startFrame", baked.startFrame);
+    w->Emit("numFrames", baked.pos.size());
+    AddToBuffer(baked.pos, "pos", DatSectionType::AnimTrack, w);
+    AddToBuffer(baked.quat, "quat", DatSectionType::AnimTrack, w);
+    AddToBuffer(baked.scale, "scale", DatSectionType::AnimTrack, w);
+  }
+
   ExportAnimationTracks(obj, w);
 
 }
@@ -74,7 +172,7 @@ void JsonExporter::ExportNullObjects(const vector<ImNullObject*>& nullObjects, J
 
   for (ImNullObject* obj : nullObjects)
   {
-    JsonWriter::JsonScope s(w, _objectToNodeName[obj], JsonWriter::CompoundType::Object);
+    JsonWriter::JsonScope s(w, objectToNodeName[obj], JsonWriter::CompoundType::Object);
     ExportBase(obj, w);
   }
 }
@@ -86,7 +184,7 @@ void JsonExporter::ExportCameras(const vector<ImCamera*>& cameras, JsonWriter* w
 
   for (ImCamera* cam : cameras)
   {
-    JsonWriter::JsonScope s(w, _objectToNodeName[cam], JsonWriter::CompoundType::Object);
+    JsonWriter::JsonScope s(w, objectToNodeName[cam], JsonWriter::CompoundType::Object);
     ExportBase(cam, w);
     w->Emit("nearPlane", cam->nearPlane);
     w->Emit("farPlane", cam->farPlane);
@@ -106,7 +204,7 @@ void JsonExporter::ExportLights(const vector<ImLight*>& lights, JsonWriter* w)
 
   for (ImLight* light : lights)
   {
-    JsonWriter::JsonScope s(w, _objectToNodeName[light], JsonWriter::CompoundType::Object);
+    JsonWriter::JsonScope s(w, objectToNodeName[light], JsonWriter::CompoundType::Object);
     ExportBase(light, w);
 
     w->Emit("type", lightTypeToString[light->type]);
@@ -151,10 +249,10 @@ void JsonExporter::ExportWorldGeometry(JsonWriter* w)
   w->Emit("numIndices", faces.size() * 3);
   w->Emit("numVertices", vertices.size());
 
-  AddToBuffer(faces, "indexData", w);
-  AddToBuffer(vertices, "vertexData", w);
-  AddToBuffer(vertexNormals, "vertexNormalData", w);
-  AddToBuffer(faceNormals, "faceNormalData", w);
+  AddToBuffer(faces, "indexData", DatSectionType::WorldGeometry, w);
+  AddToBuffer(vertices, "vertexData", DatSectionType::WorldGeometry, w);
+  AddToBuffer(vertexNormals, "vertexNormalData", DatSectionType::WorldGeometry, w);
+  AddToBuffer(faceNormals, "faceNormalData", DatSectionType::WorldGeometry, w);
 }
 
 //------------------------------------------------------------------------------
@@ -180,8 +278,39 @@ void JsonExporter::ExportMeshData(ImMesh* mesh, JsonWriter* w)
       w->Emit("elementSize", data.elementSize);
       w->Emit("numElements", dataStream.NumElems());
 
+      if (dataStream.type == ImMesh::DataStream::Type::PosQuantized16)
+      {
+        // pos = offset + q * scale
+        const vec3& minValue = mesh->aabb.minValue;
+        vec3 scale = (mesh->aabb.maxValue - minValue) / 65535.0f;
+        JsonWriter::JsonScope s(w, "dequantize", JsonWriter::CompoundType::Object);
+        w->EmitArray("offset", { minValue.x, minValue.y, minValue.z });
+        w->EmitArray("scale", { scale.x, scale.y, scale.z });
+      }
+      else if (dataStream.type == ImMesh::DataStream::Type::UVUnorm16)
+      {
+        JsonWriter::JsonScope s(w, "dequantize", JsonWriter::CompoundType::Object);
+        w->EmitArray("offset", { 0.0f, 0.0f });
+        w->EmitArray("scale", { 1 / 65535.0f, 1 / 65535.0f });
+      }
+      else if (dataStream.type == ImMesh::DataStream::Type::IndexCompressed)
+      {
+        // the decoder needs the triangle count, and the format is also stored in the stream itself
+        int numIndices = 0;
+        for (const ImMesh::MaterialGroup& m : mesh->materialGroups)
+          numIndices += m.indexCount;
+        for (const ImMesh::Lod& lod : mesh->lods)
+        {
+          for (const ImMesh::MaterialGroup& m : lod.materialGroups)
+            numIndices += m.indexCount;
+        }
+        w->Emit("numTriangles", numIndices / 3);
+        bool perIndice = CompressedIndexFormat(dataStream.data) == IBCF_PER_INDICE_1;
+        w->Emit("format", perIndice ? "perIndice" : "perTriangle");
+      }
+
       // copy the stream data to the buffer
-      AddToBuffer(dataStream.data, "data", w);
+      AddToBuffer(dataStream.data, "data", DatSectionType::MeshStream, w);
     }
   }
 
@@ -196,11 +325,90 @@ void JsonExporter::ExportMeshData(ImMesh* mesh, JsonWriter* w)
       w->Emit("indexCount", m.indexCount);
     }
   }
+
+  if (!mesh->meshletGroups.empty())
+  {
+    // a meshlet is {vertexOffset, vertexCount, triangleOffset, triangleCount}, and its bounds are
+    // {center.xyz, radius, coneApex.xyz, coneAxis.xyz, coneCutoff}
+    JsonWriter::JsonScope s(w, "meshlets", JsonWriter::CompoundType::Object);
+    w->Emit("maxVertices", MESHLET_MAX_VERTICES);
+    w->Emit("maxTriangles", MESHLET_MAX_TRIANGLES);
+    JsonWriter::JsonScope s2(w, "groups", JsonWriter::CompoundType::Array);
+    for (const ImMesh::MeshletGroup& g : mesh->meshletGroups)
+    {
+      JsonWriter::JsonScope s(w, JsonWriter::CompoundType::Object);
+      w->Emit("materialId", g.materialId);
+      w->Emit("startMeshlet", g.startMeshlet);
+      w->Emit("meshletCount", g.meshletCount);
+    }
+  }
+
+  if (!mesh->lods.empty())
+  {
+    // write the lods, from finest to coarsest
+    JsonWriter::JsonScope s(w, "lods", JsonWriter::CompoundType::Array);
+    for (const ImMesh::Lod& lod : mesh->lods)
+    {
+      JsonWriter::JsonScope s(w, JsonWriter::CompoundType::Object);
+      w->Emit("error", lod.error);
+      JsonWriter::JsonScope s2(w, "materialGroups", JsonWriter::CompoundType::Array);
+      for (const ImMesh::MaterialGroup& m : lod.materialGroups)
+      {
+        JsonWriter::JsonScope s(w, JsonWriter::CompoundType::Object);
+        w->Emit("materialId", m.materialId);
+        w->Emit("startIndex", m.startIndex);
+        w->Emit("indexCount", m.indexCount);
+      }
+    }
+  }
+}
+
+//------------------------------------------------------------------------------
+void JsonExporter::ExportAnimationCurves(ImBaseObject* obj, JsonWriter* w)
+{
+  // the keyframed tracks, see ReduceKeyframes
+  if (obj->animTracks.empty())
+    return;
+
+  JsonWriter::JsonScope s(w, "animCurves", JsonWriter::CompoundType::Object);
+  for (const ImTrack& track : obj->animTracks)
+  {
+    for (const ImCurve& curve : track.curves)
+    {
+      JsonWriter::JsonScope s(w, curve.name, JsonWriter::CompoundType::Object);
+      bool hermite = curve.interpolation == ImCurve::Interpolation::Hermite;
+      w->Emit("fps", instance->scene->fps);
+      w->Emit("numKeys", curve.keyframes.size());
+      if (curve.keyframes.size() == 1)
+      {
+        // constant track
+        w->Emit("value", curve.keyframes[0].value);
+        continue;
+      }
+
+      w->Emit("interpolation", hermite ? "hermite" : "linear");
+      vector<int> frames;
+      vector<float> values, tangents;
+      for (const ImKeyframe& key : curve.keyframes)
+      {
+        frames.push_back(key.frame);
+        values.push_back(key.value);
+        tangents.push_back(key.tangent);
+      }
+
+      AddToBuffer(frames, "frames", DatSectionType::AnimTrack, w);
+      AddToBuffer(values, "values", DatSectionType::AnimTrack, w);
+      if (hermite)
+        AddToBuffer(tangents, "tangents", DatSectionType::AnimTrack, w);
+    }
+  }
 }
 
 //------------------------------------------------------------------------------
 void JsonExporter::ExportAnimationTracks(ImBaseObject* obj, JsonWriter* w)
 {
+  ExportAnimationCurves(obj, w);
+
   if (obj->sampledAnimTracks.empty())
     return;
 
@@ -211,51 +419,30 @@ void JsonExporter::ExportAnimationTracks(ImBaseObject* obj, JsonWriter* w)
     {
       JsonWriter::JsonScope s(w, track.name, JsonWriter::CompoundType::Object);
 
-      // determine best encoding
       float minValue = +FLT_MAX;
       float maxValue = -FLT_MAX;
-
       for (float v : track.values)
       {
         minValue = min(minValue, v);
         maxValue = max(maxValue, v);
       }
 
+      // constant tracks store no samples, and every key decodes to minValue
       float span = maxValue - minValue;
-
-      vector<float> normalizedValues(track.values.size());
-      for (size_t i = 0; i < track.values.size(); ++i)
-      {
-        normalizedValues[i] = (track.values[i] - minValue) / span;
-      }
-
-      float maxErr = 0.0001f;
-      u32 numBits = 8;
-      for (; numBits < 32; ++numBits)
-      {
-        bool precisionError = false;
-        for (float v : normalizedValues)
-        {
-          int m = 1 << (numBits - 1);
-          float err = fabs(v - (float)(int(m * v)) / m);
-          if (err > maxErr)
-          {
-            precisionError = true;
-            break;
-          }
-        }
-
-        if (!precisionError)
-          break;
-      }
+      u32 numBits = span > 0 ? AnimTrackBits(ANIM_TRACK_MAX_ERROR) : 0;
 
       vector<u8> data;
-      BitWriter writer;
-      for (float v : normalizedValues)
+      if (numBits)
       {
-        int m = 1 << (numBits - 1);
-        u32 vv = u32(m * v);
-        writer.Write(vv, numBits);
+        // key = minValue + q / m * span, with m = 2^(numBits - 1)
+        u32 m = 1 << (numBits - 1);
+        vector<u32> quantized;
+        QuantizeTrack(track.values, minValue, m / span, m, &quantized);
+
+        BitWriter writer;
+        for (u32 q : quantized)
+          writer.Write(q, numBits);
+        writer.CopyOut(&data);
       }
 
       w->Emit("fps", instance->scene->fps);
@@ -263,9 +450,8 @@ void JsonExporter::ExportAnimationTracks(ImBaseObject* obj, JsonWriter* w)
       w->Emit("minValue", minValue);
       w->Emit("maxValue", maxValue);
       w->Emit("bitLength", numBits);
-      writer.CopyOut(&data);
 
-      AddToBuffer(data, "data", w);
+      AddToBuffer(data, "data", DatSectionType::AnimTrack, w);
     }
   }
 }
@@ -277,10 +463,11 @@ void JsonExporter::ExportMeshes(const vector<ImMesh*>& meshes, JsonWriter* w)
 
   for (ImMesh* mesh : meshes)
   {
-    JsonWriter::JsonScope s(w, _objectToNodeName[mesh], JsonWriter::CompoundType::Object);
+    JsonWriter::JsonScope s(w, objectToNodeName[mesh], JsonWriter::CompoundType::Object);
 
     ExportBase(mesh, w);
-    ExportMeshData(mesh, w);
+    // the streams and groups are in the shared geometry record
+    w->Emit("geometryId", mesh->geometryId);
     {
       JsonWriter::JsonScope s(w, "boundingSphere", JsonWriter::CompoundType::Object);
       w->Emit("radius", mesh->boundingSphere.radius);
@@ -298,6 +485,20 @@ void JsonExporter::ExportMeshes(const vector<ImMesh*>& meshes, JsonWriter* w)
   }
 }
 
+//------------------------------------------------------------------------------
+void JsonExporter::ExportGeometries(const vector<ImMesh*>& geometries, JsonWriter* w)
+{
+  // one record per unique mesh, indexed by geometryId, so instanced meshes only store their data once
+  JsonWriter::JsonScope s(w, "geometries", JsonWriter::CompoundType::Array);
+
+  for (ImMesh* mesh : geometries)
+  {
+    JsonWriter::JsonScope s(w, JsonWriter::CompoundType::Object);
+    w->Emit("id", mesh->geometryId);
+    ExportMeshData(mesh, w);
+  }
+}
+
 //------------------------------------------------------------------------------
 void JsonExporter::ExportPrimitives(const vector<ImPrimitive*>& primitives, JsonWriter* w)
 {
@@ -328,10 +529,10 @@ void JsonExporter::ExportSceneInfo(JsonWriter* w)
   {
     unordered_map<string, int> nodeIdx;
 
-    auto& fnAddElem = [&nodeIdx, w, &allObjects](const char* base, ImBaseObject* obj) {
+    auto& fnAddElem = [this, &nodeIdx, w, &allObjects](const char* base, ImBaseObject* obj) {
       char name[32];
       sprintf(name, "%s%.5d", base, ++nodeIdx[base]);
-      _objectToNodeName[obj] = name;
+      objectToNodeName[obj] = name;
       allObjects.push_back(obj);
     };
 
@@ -352,7 +553,7 @@ void JsonExporter::ExportSceneInfo(JsonWriter* w)
     JsonWriter::JsonScope s(w, "nodes", JsonWriter::CompoundType::Object);
     for (ImBaseObject* obj : allObjects)
     {
-      JsonWriter::JsonScope s(w, _objectToNodeName[obj], JsonWriter::CompoundType::Object);
+      JsonWriter::JsonScope s(w, objectToNodeName[obj], JsonWriter::CompoundType::Object);
       vector<string> children;
       for (ImBaseObject* obj : obj->children)
         children.push_back(obj->name);
@@ -361,6 +562,7 @@ void JsonExporter::ExportSceneInfo(JsonWriter* w)
   }
 
   w->Emit("buffer", instance->options.outputBase + ".dat");
+  w->Emit("bufferVersion", DAT_VERSION);
   {
     JsonWriter::JsonScope s(w, "geometry", JsonWriter::CompoundType::Object);
     ExportWorldGeometry(w);
@@ -538,23 +740,39 @@ bool JsonExporter::Export(SceneStats* stats)
   {
     JsonWriter::JsonScope s(&w, JsonWriter::CompoundType::Object);
 
-    ExportSceneInfo(&w);
+    // each section is timed on its own
+    auto fnStage = [this](const char* name, const function<void()>& fn) {
+      ScopedStage stage(&instance->profiler, name);
+      fn();
+    };
 
-    ExportNullObjects(instance->scene->nullObjects, &w);
-    ExportCameras(instance->scene->cameras, &w);
-    ExportLights(instance->scene->lights, &w);
-    ExportMeshes(instance->scene->meshes, &w);
-    ExportMaterials(instance->scene->materials, &w);
-    ExportPrimitives(instance->scene->primitives, &w);
+    fnStage("scene info", [&] { ExportSceneInfo(&w); });
+    fnStage("null objects", [&] { ExportNullObjects(instance->scene->nullObjects, &w); });
+    fnStage("cameras", [&] { ExportCameras(instance->scene->cameras, &w); });
+    fnStage("lights", [&] { ExportLights(instance->scene->lights, &w); });
+    fnStage("meshes", [&] { ExportMeshes(instance->scene->meshes, &w); });
+    fnStage("geometries", [&] { ExportGeometries(instance->scene->geometries, &w); });
+    fnStage("materials", [&] { ExportMaterials(instance->scene->materials, &w); });
+    fnStage("primitives", [&] { ExportPrimitives(instance->scene->primitives, &w); });
 
     if (instance->options.sdf)
     {
       //CreateSDF(scene, options, &w);
       //CreateSDF2(scene, options, &w);
-      CreateSDF3(&w);
+      fnStage("sdf", [&] { CreateSDF3(&w); });
     }
   }
 
+  ScopedStage stage(&instance->profiler, "write files");
+
+  bool res = !datOpenFailed && dat.Close();
+  if (!res)
+    instance->Log(1, "Error writing data file: %s.dat\n", instance->options.outputPrefix.c_str());
+
+  stats->dataSize = (int)dat.Size();
+  stats->dedupedSize = (int)dedupedSize;
+  stats->dedupedBlobs = dedupedBlobs;
+
   // save the json file
   FILE* f = fopen(string(instance->options.outputPrefix + ".json").c_str(), "wt");
   if (f)
@@ -563,16 +781,5 @@ bool JsonExporter::Export(SceneStats* stats)
     fclose(f);
   }
 
-  // save the data buffer
-  if (buffer.size() > 0)
-  {
-    f = fopen(string(instance->options.outputPrefix + ".dat").c_str(), "wb");
-    if (f)
-    {
-      fwrite(buffer.data(), buffer.size(), 1, f);
-      fclose(f);
-    }
-  }
-
-  return true;
+  return res;
 }
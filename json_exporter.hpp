@@ -1,6 +1,7 @@
 #pragma once
 #include "im_scene.hpp"
 #include "exporter.hpp"
+#include "dat_writer.hpp"
 
 struct JsonWriter;
 
@@ -20,21 +21,29 @@ struct JsonExporter
   void ExportWorldGeometry(JsonWriter* w);
   void ExportMeshData(ImMesh* mesh, JsonWriter* w);
   void ExportAnimationTracks(ImBaseObject* obj, JsonWriter* w);
+  void ExportAnimationCurves(ImBaseObject* obj, JsonWriter* w);
   void ExportMeshes(const vector<ImMesh*>& meshes, JsonWriter* w);
+  void ExportGeometries(const vector<ImMesh*>& geometries, JsonWriter* w);
   void ExportPrimitives(const vector<ImPrimitive*>& primitives, JsonWriter* w);
   void ExportMaterials(const vector<ImMaterial*>& materials, JsonWriter* w);
   void ExportMaterialComponentShader(const ImMaterialComponent& component, JsonWriter* w);
 
   void CreateSDF3(JsonWriter* w);
 
-  void AddToBuffer(const char* data, size_t len, const string& name, JsonWriter* w);
+  void AddToBuffer(const char* data, size_t len, const string& name, DatSectionType type, JsonWriter* w);
 
   template <typename T>
-  void AddToBuffer(const vector<T>& v, const string& name, JsonWriter* w)
+  void AddToBuffer(const vector<T>& v, const string& name, DatSectionType type, JsonWriter* w)
   {
-    AddToBuffer((const char*)v.data(), v.size() * sizeof(T), name, w);
+    AddToBuffer((const char*)v.data(), v.size() * sizeof(T), name, type, w);
   }
 
   ExportInstance* instance;
+  unordered_map<ImBaseObject*, string> objectToNodeName;
+  // the .dat file, which is written as the blobs are added, and opened on the first one
+  DatWriter dat;
+  bool datOpenFailed = false;
+  size_t dedupedSize = 0;
+  int dedupedBlobs = 0;
 };
 
@@ -0,0 +1,165 @@
+#include "keyframe_reduce.hpp"
+
+namespace
+{
+  //------------------------------------------------------------------------------
+  float Hermite(float p0, float m0, float p1, float m1, float t)
+  {
+    float t2 = t * t;
+    float t3 = t2 * t;
+    return (2 * t3 - 3 * t2 + 1) * p0 + (t3 - 2 * t2 + t) * m0 + (-2 * t3 + 3 * t2) * p1 + (t3 - t2) * m1;
+  }
+
+  //------------------------------------------------------------------------------
+  void FitLinear(const vector<float>& values, float tolerance, vector<int>* keys)
+  {
+    // swing door: every sample between two keys limits the slope of the line from the first key, and
+    // the segment is extended as long as the line to the next sample is within all the limits
+    int n = (int)values.size();
+    keys->push_back(0);
+    int start = 0;
+    while (start < n - 1)
+    {
+      float lo = -FLT_MAX, hi = FLT_MAX;
+      int end = start + 1;
+      for (int i = start + 1; i < n; ++i)
+      {
+        float dx = (float)(i - start);
+        float slope = (values[i] - values[start]) / dx;
+        if (slope < lo || slope > hi)
+          break;
+
+        end = i;
+        lo = max(lo, (values[i] - tolerance - values[start]) / dx);
+        hi = min(hi, (values[i] + tolerance - values[start]) / dx);
+      }
+
+      keys->push_back(end);
+      start = end;
+    }
+  }
+
+  //------------------------------------------------------------------------------
+  float Tangent(const vector<float>& values, int idx)
+  {
+    // per frame derivative of the samples
+    int n = (int)values.size();
+    if (n < 2)
+      return 0;
+    if (idx == 0)
+      return values[1] - values[0];
+    if (idx == n - 1)
+      return values[n - 1] - values[n - 2];
+    return (values[idx + 1] - values[idx - 1]) * 0.5f;
+  }
+
+  //------------------------------------------------------------------------------
+  bool HermiteSegmentFits(const vector<float>& values, int start, int end, float tolerance)
+  {
+    float len = (float)(end - start);
+    float m0 = Tangent(values, start) * len;
+    float m1 = Tangent(values, end) * len;
+    for (int i = start + 1; i < end; ++i)
+    {
+      float v = Hermite(values[start], m0, values[end], m1, (i - start) / len);
+      if (fabsf(v - values[i]) > tolerance)
+        return false;
+    }
+    return true;
+  }
+
+  //------------------------------------------------------------------------------
+  void FitHermite(const vector<float>& values, float tolerance, vector<int>* keys)
+  {
+    // grow each segment by doubling until it stops fitting, then binary search for the longest one that
+    // does. every accepted segment is checked, so the result is always within tolerance
+    int n = (int)values.size();
+    keys->push_back(0);
+    int start = 0;
+    while (start < n - 1)
+    {
+      int good = start + 1;
+      int step = 1;
+      int bad = n;
+      while (good < n - 1)
+      {
+        int cand = min(start + step * 2, n - 1);
+        if (!HermiteSegmentFits(values, start, cand, tolerance))
+        {
+          bad = cand;
+          break;
+        }
+        good = cand;
+        step *= 2;
+      }
+
+      while (bad - good > 1)
+      {
+        int mid = (good + bad) / 2;
+        if (HermiteSegmentFits(values, start, mid, tolerance))
+          good = mid;
+        else
+          bad = mid;
+      }
+
+      keys->push_back(good);
+      start = good;
+    }
+  }
+}
+
+//------------------------------------------------------------------------------
+void ReduceKeyframes(const vector<float>& values, int startFrame, float tolerance, ImCurve* curve)
+{
+  curve->keyframes.clear();
+  curve->interpolation = ImCurve::Interpolation::Linear;
+  if (values.empty())
+    return;
+
+  float minValue = *min_element(values.begin(), values.end());
+  float maxValue = *max_element(values.begin(), values.end());
+  if (maxValue - minValue <= 2 * tolerance)
+  {
+    // constant within the tolerance, so the midpoint is close enough everywhere
+    curve->keyframes.push_back(ImKeyframe{startFrame, (minValue + maxValue) / 2, 0});
+    return;
+  }
+
+  vector<int> linearKeys, hermiteKeys;
+  FitLinear(values, tolerance, &linearKeys);
+  FitHermite(values, tolerance, &hermiteKeys);
+
+  // a hermite key also stores a tangent, so it has to save more than that to win
+  bool useHermite = hermiteKeys.size() * 3 < linearKeys.size() * 2;
+  const vector<int>& keys = useHermite ? hermiteKeys : linearKeys;
+  curve->interpolation = useHermite ? ImCurve::Interpolation::Hermite : ImCurve::Interpolation::Linear;
+  curve->keyframes.reserve(keys.size());
+  for (int idx : keys)
+  {
+    float tangent = useHermite ? Tangent(values, idx) : 0;
+    curve->keyframes.push_back(ImKeyframe{startFrame + idx, values[idx], tangent});
+  }
+}
+
+//------------------------------------------------------------------------------
+float EvalCurve(const ImCurve& curve, float frame)
+{
+  const vector<ImKeyframe>& keys = curve.keyframes;
+  if (keys.empty())
+    return 0;
+  if (frame <= keys.front().frame)
+    return keys.front().value;
+  if (frame >= keys.back().frame)
+    return keys.back().value;
+
+  auto it = upper_bound(keys.begin(), keys.end(), frame, [](float f, const ImKeyframe& k) {
+    return f < k.frame;
+  });
+  const ImKeyframe& k1 = *it;
+  const ImKeyframe& k0 = *(it - 1);
+  float len = (float)(k1.frame - k0.frame);
+  float t = (frame - k0.frame) / len;
+  if (curve.interpolation == ImCurve::Interpolation::Linear)
+    return k0.value + (k1.value - k0.value) * t;
+  return Hermite(k0.value, k0.tangent * len, k1.value, k1.tangent * len, t);
+}
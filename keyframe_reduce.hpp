@@ -0,0 +1,11 @@
+#pragma once
+#include "im_scene.hpp"
+
+//------------------------------------------------------------------------------
+// Fits a curve through values sampled once per frame, starting at startFrame, so that evaluating the
+// curve at any of the sampled frames is within tolerance of the sample. Both a linear and a cubic hermite
+// fit are made, and the one with the fewest keys is kept. Constant tracks become a single key.
+void ReduceKeyframes(const vector<float>& values, int startFrame, float tolerance, ImCurve* curve);
+
+// Evaluates the curve at the given frame, clamping outside the keys
+float EvalCurve(const ImCurve& curve, float frame);
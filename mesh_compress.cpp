@@ -0,0 +1,151 @@
+#include "mesh_compress.hpp"
+#include "compress/indexbuffercompression.h"
+#include "compress/indexbufferdecompression.h"
+// oct.h defines its functions in the header, so it can only be included here
+#include "compress/oct.h"
+
+//------------------------------------------------------------------------------
+void CompressIndices(
+    const vector<u32>& indices, int vertexCount, vector<char>* out, vector<u32>* vertexRemap)
+{
+  vertexRemap->resize(vertexCount);
+
+  WriteBitstream bitstream(max<size_t>(16, (indices.size() + 7) & ~7));
+  CompressIndexBuffer(
+      indices.data(), (u32)indices.size() / 3, vertexRemap->data(), vertexCount, IBCF_AUTO, bitstream);
+  bitstream.Finish();
+
+  // the reader always loads whole 64 bit words, so keep the padding that Finish writes
+  size_t size = (bitstream.ByteSize() + 7) & ~7;
+  const char* data = (const char*)bitstream.RawData();
+  out->assign(data, data + size);
+}
+
+//------------------------------------------------------------------------------
+void DecompressIndices(const vector<char>& data, int numTriangles, vector<u32>* indices)
+{
+  indices->resize(numTriangles * 3);
+  ReadBitstream bitstream((const uint8_t*)data.data(), data.size());
+  DecompressIndexBuffer(indices->data(), numTriangles, bitstream);
+}
+
+//------------------------------------------------------------------------------
+bool VerifyCompressedIndices(
+    const vector<u32>& indices, const vector<u32>& vertexRemap, const vector<char>& data)
+{
+  int numTriangles = (int)indices.size() / 3;
+  vector<u32> decompressed;
+  DecompressIndices(data, numTriangles, &decompressed);
+
+  for (int i = 0; i < numTriangles; ++i)
+  {
+    const u32* src = &indices[i * 3];
+    const u32* dst = &decompressed[i * 3];
+    u32 a = vertexRemap[src[0]], b = vertexRemap[src[1]], c = vertexRemap[src[2]];
+    bool match = (dst[0] == a && dst[1] == b && dst[2] == c) || (dst[0] == b && dst[1] == c && dst[2] == a)
+                 || (dst[0] == c && dst[1] == a && dst[2] == b);
+    if (!match)
+      return false;
+  }
+  return true;
+}
+
+//------------------------------------------------------------------------------
+int CompressedIndexFormat(const vector<char>& data)
+{
+  ReadBitstream bitstream((const uint8_t*)data.data(), data.size());
+  return (int)bitstream.ReadVInt();
+}
+
+//------------------------------------------------------------------------------
+void QuantizePositions(
+    const float* pos, int count, const vec3& minValue, const vec3& maxValue, vector<u16>* out)
+{
+  float lo[3] = { minValue.x, minValue.y, minValue.z };
+  float scale[3];
+  float span[3] = { maxValue.x - minValue.x, maxValue.y - minValue.y, maxValue.z - minValue.z };
+  for (int i = 0; i < 3; ++i)
+    scale[i] = span[i] > 0 ? 65535 / span[i] : 0;
+
+  out->resize(count * 3);
+  u16* dst = out->data();
+  for (int i = 0; i < count * 3; ++i)
+  {
+    float q = (pos[i] - lo[i % 3]) * scale[i % 3] + 0.5f;
+    dst[i] = (u16)min(65535.0f, max(0.0f, q));
+  }
+}
+
+//------------------------------------------------------------------------------
+void EncodeNormalsOct(const float* normals, int count, vector<s16>* out)
+{
+  out->resize(count * 2);
+  for (int i = 0; i < count; ++i)
+  {
+    const float* n = &normals[i * 3];
+    if (n[0] == 0 && n[1] == 0 && n[2] == 0)
+    {
+      // octEncode divides by the L1 norm
+      (*out)[i * 2 + 0] = (*out)[i * 2 + 1] = 0;
+      continue;
+    }
+
+    Snorm<snormSize> projected[2];
+    octEncode(n, projected);
+    (*out)[i * 2 + 0] = (s16)projected[0].bits();
+    (*out)[i * 2 + 1] = (s16)projected[1].bits();
+  }
+}
+
+//------------------------------------------------------------------------------
+bool EncodeUVs(const float* uvs, int count, vector<u16>* out)
+{
+  bool normalized = true;
+  for (int i = 0; i < count * 2; ++i)
+    normalized &= uvs[i] >= 0 && uvs[i] <= 1;
+
+  out->resize(count * 2);
+  for (int i = 0; i < count * 2; ++i)
+    (*out)[i] = normalized ? (u16)(uvs[i] * 65535 + 0.5f) : FloatToHalf(uvs[i]);
+
+  return normalized;
+}
+
+//------------------------------------------------------------------------------
+u16 FloatToHalf(float f)
+{
+  // round to nearest even, with overflow to inf, and nans kept as nans
+  u32 x;
+  memcpy(&x, &f, sizeof(x));
+  u32 sign = (x >> 16) & 0x8000;
+  u32 absX = x & 0x7fffffff;
+
+  if (absX >= 0x7f800000)
+    return (u16)(sign | 0x7c00 | (absX > 0x7f800000 ? 0x200 : 0));
+
+  // 65520 and up rounds to inf
+  if (absX >= 0x477ff000)
+    return (u16)(sign | 0x7c00);
+
+  if (absX < 0x38800000)
+  {
+    // denormal (or zero) half. shift the mantissa, including the implicit bit, into place
+    int shift = 126 - (int)(absX >> 23);
+    if (shift > 24)
+      return (u16)sign;
+    u32 mantissa = (absX & 0x7fffff) | 0x800000;
+    u32 half = mantissa >> shift;
+    u32 rest = mantissa & ((1u << shift) - 1);
+    u32 halfway = 1u << (shift - 1);
+    if (rest > halfway || (rest == halfway && (half & 1)))
+      ++half;
+    return (u16)(sign | half);
+  }
+
+  // rebias the exponent, and round the mantissa. a carry into the exponent is correct
+  u32 half = (absX - 0x38000000) >> 13;
+  u32 rest = absX & 0x1fff;
+  if (rest > 0x1000 || (rest == 0x1000 && (half & 1)))
+    ++half;
+  return (u16)(sign | half);
+}
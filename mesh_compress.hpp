@@ -0,0 +1,34 @@
+#pragma once
+#include "exporter_types.hpp"
+
+//------------------------------------------------------------------------------
+// Compresses a triangle list with CompressIndexBuffer (IBCF_AUTO). The compressed indices refer to
+// renumbered vertices, and vertexRemap[old] = new gives the order the vertex data must be written in.
+// Triangles keep their order, but their vertices can be rotated.
+void CompressIndices(
+    const vector<u32>& indices, int vertexCount, vector<char>* out, vector<u32>* vertexRemap);
+
+// Decompresses numTriangles triangles from a buffer written by CompressIndices
+void DecompressIndices(const vector<char>& data, int numTriangles, vector<u32>* indices);
+
+// Decompresses the buffer and checks that every triangle matches the remapped input triangle, up to
+// rotation
+bool VerifyCompressedIndices(
+    const vector<u32>& indices, const vector<u32>& vertexRemap, const vector<char>& data);
+
+// Returns the IndexBufferCompressionFormat recorded at the start of the compressed buffer
+int CompressedIndexFormat(const vector<char>& data);
+
+//------------------------------------------------------------------------------
+// Quantizes xyz positions to unorm16 against the bounding box, so
+// pos = minValue + q * (maxValue - minValue) / 65535
+void QuantizePositions(
+    const float* pos, int count, const vec3& minValue, const vec3& maxValue, vector<u16>* out);
+
+// Octahedral encodes xyz normals to 2 snorm16 values
+void EncodeNormalsOct(const float* normals, int count, vector<s16>* out);
+
+// Encodes uvs as unorm16 if they are all in [0, 1], and as half floats otherwise. Returns true for unorm16.
+bool EncodeUVs(const float* uvs, int count, vector<u16>* out);
+
+u16 FloatToHalf(float f);
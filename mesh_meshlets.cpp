@@ -0,0 +1,176 @@
+#include "mesh_meshlets.hpp"
+
+//------------------------------------------------------------------------------
+void BuildMeshlets(
+    const u32* indices,
+    int indexCount,
+    int vertexCount,
+    vector<Meshlet>* meshlets,
+    vector<u32>* meshletVertices,
+    vector<u8>* meshletTriangles)
+{
+  int numTris = indexCount / 3;
+
+  // vertex -> triangle adjacency, as offsets into a flat list
+  vector<int> triStart(vertexCount + 1, 0);
+  for (int i = 0; i < numTris * 3; ++i)
+    triStart[indices[i] + 1]++;
+  for (int i = 0; i < vertexCount; ++i)
+    triStart[i + 1] += triStart[i];
+
+  vector<int> triList(numTris * 3);
+  vector<int> cursor(triStart.begin(), triStart.end() - 1);
+  for (int i = 0; i < numTris * 3; ++i)
+    triList[cursor[indices[i]]++] = i / 3;
+
+  vector<u8> emitted(numTris, 0);
+  // index of each vertex in the current meshlet, or -1
+  vector<int> localIdx(vertexCount, -1);
+
+  Meshlet cur = {(u32)meshletVertices->size(), 0, (u32)meshletTriangles->size() / 3, 0};
+
+  auto fnNewVertices = [&](int tri) {
+    int res = 0;
+    for (int i = 0; i < 3; ++i)
+      res += localIdx[indices[tri * 3 + i]] == -1;
+    return res;
+  };
+
+  auto fnAddTriangle = [&](int tri) {
+    for (int i = 0; i < 3; ++i)
+    {
+      u32 v = indices[tri * 3 + i];
+      if (localIdx[v] == -1)
+      {
+        localIdx[v] = cur.vertexCount++;
+        meshletVertices->push_back(v);
+      }
+      meshletTriangles->push_back((u8)localIdx[v]);
+    }
+    emitted[tri] = 1;
+    cur.triangleCount++;
+  };
+
+  auto fnFlush = [&]() {
+    if (!cur.triangleCount)
+      return;
+    meshlets->push_back(cur);
+    for (u32 i = cur.vertexOffset; i < cur.vertexOffset + cur.vertexCount; ++i)
+      localIdx[(*meshletVertices)[i]] = -1;
+    cur = {(u32)meshletVertices->size(), 0, (u32)meshletTriangles->size() / 3, 0};
+  };
+
+  int seed = 0;
+  while (true)
+  {
+    // pick the unused triangle next to the meshlet that adds the fewest vertices
+    int best = -1;
+    int bestNew = 4;
+    for (u32 i = cur.vertexOffset; i < cur.vertexOffset + cur.vertexCount && bestNew > 0; ++i)
+    {
+      u32 v = (*meshletVertices)[i];
+      for (int j = triStart[v]; j < triStart[v + 1]; ++j)
+      {
+        int tri = triList[j];
+        if (emitted[tri])
+          continue;
+
+        int numNew = fnNewVertices(tri);
+        if (numNew < bestNew)
+        {
+          best = tri;
+          bestNew = numNew;
+        }
+      }
+    }
+
+    if (best == -1)
+    {
+      // nothing connected is left, so continue with the next unused triangle in index order
+      while (seed < numTris && emitted[seed])
+        ++seed;
+      if (seed == numTris)
+        break;
+      best = seed;
+      bestNew = fnNewVertices(best);
+    }
+
+    if (cur.vertexCount + bestNew > MESHLET_MAX_VERTICES || cur.triangleCount + 1 > MESHLET_MAX_TRIANGLES)
+      fnFlush();
+
+    fnAddTriangle(best);
+  }
+
+  fnFlush();
+}
+
+//------------------------------------------------------------------------------
+MeshletBounds CalcMeshletBounds(
+    const Meshlet& meshlet, const u32* meshletVertices, const u8* meshletTriangles, const vec3* pos)
+{
+  const u32* verts = meshletVertices + meshlet.vertexOffset;
+  const u8* tris = meshletTriangles + meshlet.triangleOffset * 3;
+
+  MeshletBounds res;
+
+  // the sphere is centered on the aabb
+  vec3 minValue = pos[verts[0]];
+  vec3 maxValue = pos[verts[0]];
+  for (u32 i = 1; i < meshlet.vertexCount; ++i)
+  {
+    minValue = Min(minValue, pos[verts[i]]);
+    maxValue = Max(maxValue, pos[verts[i]]);
+  }
+
+  vec3 center = (minValue + maxValue) * 0.5f;
+  float radius = 0;
+  for (u32 i = 0; i < meshlet.vertexCount; ++i)
+    radius = max(radius, Length(pos[verts[i]] - center));
+  res.sphere = {center, radius};
+
+  // the cone axis is the average of the triangle normals, and the spread is the largest angle to it
+  vector<vec3> normals(meshlet.triangleCount);
+  vec3 normalSum(0, 0, 0);
+  for (u32 i = 0; i < meshlet.triangleCount; ++i)
+  {
+    const vec3& a = pos[verts[tris[i * 3 + 0]]];
+    const vec3& b = pos[verts[tris[i * 3 + 1]]];
+    const vec3& c = pos[verts[tris[i * 3 + 2]]];
+    normals[i] = Normalize(Cross(b - a, c - a));
+    normalSum += normals[i];
+  }
+
+  vec3 axis = Normalize(normalSum);
+  float minDot = 1;
+  for (const vec3& n : normals)
+  {
+    // skip degenerate triangles
+    if (n.x != 0 || n.y != 0 || n.z != 0)
+      minDot = min(minDot, Dot(axis, n));
+  }
+
+  res.coneApex = center;
+  res.coneAxis = vec3(0, 0, 0);
+  res.coneCutoff = 1;
+
+  // with a spread of close to 90 degrees or more, the apex would be too far away to be useful
+  if (LengthSq(normalSum) == 0 || minDot <= 0.1f)
+    return res;
+
+  // move the apex back along the axis until it's behind all the triangle planes, so the cone contains
+  // every point that sees the front of a triangle
+  float maxT = 0;
+  for (u32 i = 0; i < meshlet.triangleCount; ++i)
+  {
+    const vec3& n = normals[i];
+    if (n.x == 0 && n.y == 0 && n.z == 0)
+      continue;
+    const vec3& a = pos[verts[tris[i * 3 + 0]]];
+    maxT = max(maxT, Dot(n, a - center) / Dot(axis, n));
+  }
+
+  res.coneApex = center - axis * maxT;
+  res.coneAxis = axis;
+  res.coneCutoff = sqrtf(1 - minDot * minDot);
+  return res;
+}
@@ -0,0 +1,46 @@
+#pragma once
+#include "im_scene.hpp"
+
+static const int MESHLET_MAX_VERTICES = 64;
+static const int MESHLET_MAX_TRIANGLES = 124;
+
+//------------------------------------------------------------------------------
+struct Meshlet
+{
+  // range in the meshlet vertex list, which holds indices into the mesh vertices
+  u32 vertexOffset;
+  u32 vertexCount;
+  // range in the meshlet triangle list, which holds 3 u8 indices into the meshlet's vertices per triangle
+  u32 triangleOffset;
+  u32 triangleCount;
+};
+
+//------------------------------------------------------------------------------
+struct MeshletBounds
+{
+  ImSphere sphere;
+  // the meshlet is back facing, and can be culled, if
+  // dot(normalize(coneApex - cameraPos), coneAxis) >= coneCutoff
+  // meshlets with too wide a cone get a zero axis and a cutoff of 1, so they are never culled
+  vec3 coneApex;
+  vec3 coneAxis;
+  float coneCutoff;
+};
+static_assert(sizeof(MeshletBounds) == 11 * sizeof(float), "MeshletBounds is written out as is");
+
+//------------------------------------------------------------------------------
+// Splits a triangle list into meshlets of at most MESHLET_MAX_VERTICES vertices and MESHLET_MAX_TRIANGLES
+// triangles. Each meshlet is grown from a seed triangle by adding the neighboring triangle that needs the
+// fewest new vertices, so meshlets are compact and their bounds are tight. The results are appended to
+// meshlets, meshletVertices and meshletTriangles, and the offsets index into the full lists.
+void BuildMeshlets(
+    const u32* indices,
+    int indexCount,
+    int vertexCount,
+    vector<Meshlet>* meshlets,
+    vector<u32>* meshletVertices,
+    vector<u8>* meshletTriangles);
+
+//------------------------------------------------------------------------------
+MeshletBounds CalcMeshletBounds(
+    const Meshlet& meshlet, const u32* meshletVertices, const u8* meshletTriangles, const vec3* pos);
@@ -0,0 +1,272 @@
+#include "mesh_simplify.hpp"
+
+namespace
+{
+  //------------------------------------------------------------------------------
+  struct Quadric
+  {
+    // symmetric 4x4 matrix, plus the total weight so the error can be normalized to a squared distance
+    double a00 = 0, a01 = 0, a02 = 0, a11 = 0, a12 = 0, a22 = 0;
+    double b0 = 0, b1 = 0, b2 = 0, c = 0;
+    double w = 0;
+
+    void AddPlane(double nx, double ny, double nz, double d, double weight)
+    {
+      a00 += weight * nx * nx;
+      a01 += weight * nx * ny;
+      a02 += weight * nx * nz;
+      a11 += weight * ny * ny;
+      a12 += weight * ny * nz;
+      a22 += weight * nz * nz;
+      b0 += weight * nx * d;
+      b1 += weight * ny * d;
+      b2 += weight * nz * d;
+      c += weight * d * d;
+      w += weight;
+    }
+
+    void Add(const Quadric& q)
+    {
+      a00 += q.a00;
+      a01 += q.a01;
+      a02 += q.a02;
+      a11 += q.a11;
+      a12 += q.a12;
+      a22 += q.a22;
+      b0 += q.b0;
+      b1 += q.b1;
+      b2 += q.b2;
+      c += q.c;
+      w += q.w;
+    }
+
+    double Error(const vec3& p) const
+    {
+      // p^T A p + 2 b.p + c, divided by the weight to get the mean squared distance to the planes
+      double x = p.x, y = p.y, z = p.z;
+      double e = a00 * x * x + a11 * y * y + a22 * z * z + 2 * (a01 * x * y + a02 * x * z + a12 * y * z)
+                 + 2 * (b0 * x + b1 * y + b2 * z) + c;
+      return w > 0 ? max(0.0, e / w) : 0;
+    }
+  };
+
+  //------------------------------------------------------------------------------
+  struct Collapse
+  {
+    double error;
+    u32 src;
+    u32 dst;
+
+    bool operator<(const Collapse& rhs) const
+    {
+      if (error != rhs.error)
+        return error < rhs.error;
+      return src < rhs.src || (src == rhs.src && dst < rhs.dst);
+    }
+  };
+
+  //------------------------------------------------------------------------------
+  vec3 TriangleNormal(const vec3& a, const vec3& b, const vec3& c)
+  {
+    return Cross(b - a, c - a);
+  }
+}
+
+//------------------------------------------------------------------------------
+float SimplifyIndices(
+    const vector<vec3>& pos, const u32* indices, int indexCount, int targetIndexCount, vector<u32>* out)
+{
+  u32 vertexCount = (u32)pos.size();
+  out->assign(indices, indices + indexCount);
+
+  // lock vertices that share a position with another vertex, as they are on a uv or normal seam
+  vector<u8> locked(vertexCount, 0);
+  {
+    vector<u32> byPos(vertexCount);
+    for (u32 i = 0; i < vertexCount; ++i)
+      byPos[i] = i;
+    auto fnLess = [&](u32 a, u32 b) {
+      const vec3& pa = pos[a];
+      const vec3& pb = pos[b];
+      return pa.x < pb.x || (pa.x == pb.x && (pa.y < pb.y || (pa.y == pb.y && pa.z < pb.z)));
+    };
+    sort(byPos.begin(), byPos.end(), fnLess);
+    for (u32 i = 1; i < vertexCount; ++i)
+    {
+      if (!fnLess(byPos[i - 1], byPos[i]))
+        locked[byPos[i - 1]] = locked[byPos[i]] = 1;
+    }
+  }
+
+  // lock vertices on open borders, ie edges that are only used by a single triangle
+  {
+    vector<u64> edges;
+    edges.reserve(indexCount);
+    for (int i = 0; i < indexCount; i += 3)
+    {
+      for (int j = 0; j < 3; ++j)
+      {
+        u32 a = indices[i + j];
+        u32 b = indices[i + (j + 1) % 3];
+        edges.push_back(((u64)min(a, b) << 32) | max(a, b));
+      }
+    }
+    sort(edges.begin(), edges.end());
+    for (size_t i = 0; i < edges.size();)
+    {
+      size_t j = i;
+      while (j < edges.size() && edges[j] == edges[i])
+        ++j;
+      if (j - i == 1)
+        locked[edges[i] >> 32] = locked[edges[i] & 0xffffffff] = 1;
+      i = j;
+    }
+  }
+
+  // area weighted plane quadrics for every vertex
+  vector<Quadric> quadrics(vertexCount);
+  for (int i = 0; i < indexCount; i += 3)
+  {
+    const vec3& p0 = pos[indices[i + 0]];
+    vec3 n = TriangleNormal(p0, pos[indices[i + 1]], pos[indices[i + 2]]);
+    float len = Length(n);
+    if (len == 0)
+      continue;
+    n = n / len;
+    double d = -Dot(n, p0);
+    for (int j = 0; j < 3; ++j)
+      quadrics[indices[i + j]].AddPlane(n.x, n.y, n.z, d, len * 0.5);
+  }
+
+  vector<u32> remap(vertexCount);
+  for (u32 i = 0; i < vertexCount; ++i)
+    remap[i] = i;
+
+  vector<Collapse> collapses;
+  vector<u32> vertexOffsets, vertexTriangles;
+  vector<u8> touched;
+  double maxError = 0;
+
+  while ((int)out->size() > targetIndexCount)
+  {
+    vector<u32>& idx = *out;
+    int numTriangles = (int)idx.size() / 3;
+
+    // collect the cheapest direction for every edge, where the source vertex can move
+    collapses.clear();
+    for (int i = 0; i < numTriangles * 3; i += 3)
+    {
+      for (int j = 0; j < 3; ++j)
+      {
+        u32 a = idx[i + j];
+        u32 b = idx[i + (j + 1) % 3];
+        // each interior edge is seen from both of its triangles, so only take it from one side
+        if (a > b)
+          continue;
+
+        Collapse best = {DBL_MAX, 0, 0};
+        for (int dir = 0; dir < 2; ++dir)
+        {
+          u32 src = dir ? b : a;
+          u32 dst = dir ? a : b;
+          if (locked[src])
+            continue;
+          Quadric q = quadrics[src];
+          q.Add(quadrics[dst]);
+          Collapse c = {q.Error(pos[dst]), src, dst};
+          if (c < best)
+            best = c;
+        }
+        if (best.error != DBL_MAX)
+          collapses.push_back(best);
+      }
+    }
+
+    if (collapses.empty())
+      break;
+    sort(collapses.begin(), collapses.end());
+
+    // vertex to triangle adjacency, for the flip check
+    vertexOffsets.assign(vertexCount + 1, 0);
+    for (u32 v : idx)
+      vertexOffsets[v + 1]++;
+    for (u32 i = 0; i < vertexCount; ++i)
+      vertexOffsets[i + 1] += vertexOffsets[i];
+    vertexTriangles.resize(idx.size());
+    {
+      vector<u32> cursor(vertexOffsets.begin(), vertexOffsets.end() - 1);
+      for (size_t i = 0; i < idx.size(); ++i)
+        vertexTriangles[cursor[idx[i]]++] = (u32)(i / 3);
+    }
+
+    // do as many non overlapping collapses as needed in this pass, cheapest first. each collapse
+    // removes about 2 triangles. the flip check and the quadrics only hold while the rest of the
+    // one-ring stays put, so a collapse locks every vertex around its source for the rest of the pass
+    int trianglesToRemove = numTriangles - targetIndexCount / 3;
+    int removed = 0;
+    touched.assign(vertexCount, 0);
+    for (const Collapse& c : collapses)
+    {
+      if (removed >= trianglesToRemove)
+        break;
+      if (touched[c.src] || touched[c.dst])
+        continue;
+
+      // reject collapses that flip any of the remaining triangles around the source vertex. turning a
+      // triangle by up to 90 degrees isn't a flip on its own, but a few of those in later passes are, so
+      // anything over 60 degrees counts
+      bool flips = false;
+      int collapsedTriangles = 0;
+      for (u32 i = vertexOffsets[c.src]; i < vertexOffsets[c.src + 1] && !flips; ++i)
+      {
+        u32 tri = vertexTriangles[i];
+        u32 v[3] = {remap[idx[tri * 3 + 0]], remap[idx[tri * 3 + 1]], remap[idx[tri * 3 + 2]]};
+        if (v[0] == c.dst || v[1] == c.dst || v[2] == c.dst)
+        {
+          ++collapsedTriangles;
+          continue;
+        }
+
+        vec3 before = TriangleNormal(pos[v[0]], pos[v[1]], pos[v[2]]);
+        for (int j = 0; j < 3; ++j)
+          v[j] = v[j] == c.src ? c.dst : v[j];
+        vec3 after = TriangleNormal(pos[v[0]], pos[v[1]], pos[v[2]]);
+        flips = Dot(before, after) <= 0.5f * Length(before) * Length(after);
+      }
+      if (flips)
+        continue;
+
+      remap[c.src] = c.dst;
+      quadrics[c.dst].Add(quadrics[c.src]);
+      for (u32 i = vertexOffsets[c.src]; i < vertexOffsets[c.src + 1]; ++i)
+      {
+        u32 tri = vertexTriangles[i];
+        touched[idx[tri * 3 + 0]] = touched[idx[tri * 3 + 1]] = touched[idx[tri * 3 + 2]] = 1;
+      }
+      maxError = max(maxError, c.error);
+      removed += collapsedTriangles;
+    }
+
+    if (removed == 0)
+      break;
+
+    // apply the collapses, and drop the triangles that became degenerate
+    size_t dst = 0;
+    for (size_t i = 0; i < idx.size(); i += 3)
+    {
+      u32 a = remap[idx[i + 0]], b = remap[idx[i + 1]], c = remap[idx[i + 2]];
+      if (a == b || a == c || b == c)
+        continue;
+      idx[dst++] = a;
+      idx[dst++] = b;
+      idx[dst++] = c;
+    }
+    idx.resize(dst);
+
+    // sources are never destinations in the same pass, so the remap is flattened by resetting it
+    for (u32 i = 0; i < vertexCount; ++i)
+      remap[i] = i;
+  }
+
+  return (float)sqrt(maxError);
+}
@@ -0,0 +1,12 @@
+#pragma once
+#include "exporter_types.hpp"
+
+//------------------------------------------------------------------------------
+// Simplifies a triangle list with quadric error edge collapses. Vertices are only ever collapsed onto
+// other existing vertices, so the result shares the vertex data with the input. Collapsing stops at
+// targetIndexCount, or when nothing more can be collapsed. Vertices on open borders, and vertices that
+// share their position with another vertex (uv or normal seams), are never moved.
+// Returns the sqrt of the largest quadric error of any collapse, ie the rms distance in the units of
+// pos from a moved vertex to the planes of the triangles it was collapsed from.
+float SimplifyIndices(
+    const vector<vec3>& pos, const u32* indices, int indexCount, int targetIndexCount, vector<u32>* out);
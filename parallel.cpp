@@ -0,0 +1,186 @@
+#include "parallel.hpp"
+#include <condition_variable>
+
+namespace
+{
+  //------------------------------------------------------------------------------
+  // A range of items, packed into a single atomic so the owner can pop from the front and other
+  // threads can steal from the back without a lock. Item indices are handed out exactly once, so a
+  // non-empty range never repeats, and a compare-exchange against a stale value always fails.
+  struct alignas(64) WorkRange
+  {
+    static u64 Pack(int begin, int end) { return ((u64)(u32)begin << 32) | (u32)end; }
+    static int Begin(u64 range) { return (int)(range >> 32); }
+    static int End(u64 range) { return (int)(range & 0xffffffff); }
+
+    bool Pop(int* idx)
+    {
+      u64 cur = range.load();
+      while (Begin(cur) < End(cur))
+      {
+        if (range.compare_exchange_weak(cur, Pack(Begin(cur) + 1, End(cur))))
+        {
+          *idx = Begin(cur);
+          return true;
+        }
+      }
+      return false;
+    }
+
+    bool Steal(int* stolenBegin, int* stolenEnd)
+    {
+      u64 cur = range.load();
+      while (Begin(cur) < End(cur))
+      {
+        int mid = Begin(cur) + (End(cur) - Begin(cur)) / 2;
+        if (range.compare_exchange_weak(cur, Pack(Begin(cur), mid)))
+        {
+          *stolenBegin = mid;
+          *stolenEnd = End(cur);
+          return true;
+        }
+      }
+      return false;
+    }
+
+    // only called by the owner, when its range is empty
+    void Set(int begin, int end) { range.store(Pack(begin, end)); }
+
+    std::atomic<u64> range{0};
+  };
+
+  //------------------------------------------------------------------------------
+  // Worker threads that are kept alive between ParallelFor calls, so small loops don't pay for
+  // starting threads. Each calling thread gets its own pool, so concurrent exports don't share one.
+  class ThreadPool
+  {
+  public:
+    ~ThreadPool()
+    {
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        quit = true;
+      }
+      wake.notify_all();
+      for (std::thread& t : threads)
+        t.join();
+    }
+
+    void Run(int numItems, int numThreads, const function<void(int)>& fn)
+    {
+      while ((int)ranges.size() < numThreads)
+        ranges.push_back(make_unique<WorkRange>());
+      for (int i = 0; i < numThreads; ++i)
+        ranges[i]->Set(numItems * i / numThreads, numItems * (i + 1) / numThreads);
+
+      while ((int)threads.size() < numThreads - 1)
+      {
+        int workerIdx = (int)threads.size() + 1;
+        threads.push_back(std::thread([this, workerIdx]() { WorkerLoop(workerIdx); }));
+      }
+
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        jobFn = &fn;
+        jobThreads = numThreads;
+        pending = numThreads - 1;
+        ++generation;
+      }
+      wake.notify_all();
+
+      // the calling thread is worker 0
+      DoWork(0);
+
+      std::unique_lock<std::mutex> lock(mutex);
+      done.wait(lock, [this]() { return pending == 0; });
+      jobFn = nullptr;
+    }
+
+  private:
+    void WorkerLoop(int workerIdx)
+    {
+      u64 seen = 0;
+      while (true)
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        wake.wait(lock, [&]() { return quit || generation != seen; });
+        if (quit)
+          return;
+        seen = generation;
+        // a call with fewer threads than the pool leaves the extra workers asleep
+        if (workerIdx >= jobThreads)
+          continue;
+
+        lock.unlock();
+        DoWork(workerIdx);
+        lock.lock();
+        if (--pending == 0)
+          done.notify_one();
+      }
+    }
+
+    void DoWork(int workerIdx)
+    {
+      WorkRange& own = *ranges[workerIdx];
+      while (true)
+      {
+        int idx;
+        while (own.Pop(&idx))
+          (*jobFn)(idx);
+
+        // out of work, so try to steal from the other threads, starting with our neighbour
+        bool stole = false;
+        for (int i = 1; i < jobThreads && !stole; ++i)
+        {
+          int stolenBegin, stolenEnd;
+          if (ranges[(workerIdx + i) % jobThreads]->Steal(&stolenBegin, &stolenEnd))
+          {
+            own.Set(stolenBegin, stolenEnd);
+            stole = true;
+          }
+        }
+
+        if (!stole)
+          break;
+      }
+    }
+
+    vector<std::thread> threads;
+    vector<unique_ptr<WorkRange>> ranges;
+
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable done;
+    u64 generation = 0;
+    bool quit = false;
+
+    // the current job, only changed while no worker is running it
+    const function<void(int)>* jobFn = nullptr;
+    int jobThreads = 0;
+    int pending = 0;
+  };
+
+  thread_local ThreadPool g_ThreadPool;
+}
+
+//------------------------------------------------------------------------------
+int NumWorkerThreads(int requested)
+{
+  if (requested > 0)
+    return requested;
+  return max(1, (int)std::thread::hardware_concurrency());
+}
+
+//------------------------------------------------------------------------------
+void ParallelFor(int numItems, int numThreads, const function<void(int)>& fn)
+{
+  numThreads = max(1, min(numThreads, numItems));
+  if (numThreads == 1)
+  {
+    for (int i = 0; i < numItems; ++i)
+      fn(i);
+    return;
+  }
+
+  g_ThreadPool.Run(numItems, numThreads, fn);
+}
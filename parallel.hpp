@@ -0,0 +1,11 @@
+#pragma once
+
+//------------------------------------------------------------------------------
+// Calls fn(idx) for every idx in [0, numItems), spread over numThreads threads (including the
+// calling thread). Each thread starts with a contiguous range of items, and threads that run out
+// of work steal the back half of another thread's remaining range. The worker threads are kept
+// alive between calls, in a pool per calling thread.
+void ParallelFor(int numItems, int numThreads, const function<void(int)>& fn);
+
+// Returns the number of threads to use, where a request of <= 0 means one per hardware thread.
+int NumWorkerThreads(int requested);
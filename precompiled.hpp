@@ -2,6 +2,13 @@
 
 #define WITH_EMBREE 0
 
+// decompress every compressed index stream again, and fall back to plain indices if it doesn't match
+#ifdef _DEBUG
+#define WITH_INDEX_COMPRESSION_CHECK 1
+#else
+#define WITH_INDEX_COMPRESSION_CHECK 0
+#endif
+
 #include <stdio.h>
 #include <assert.h>
 #include <stdint.h>
@@ -18,6 +25,9 @@
 #include <functional>
 #include <iterator>
 #include <memory>
+#include <thread>
+#include <atomic>
+#include <mutex>
 
 #include <c4d_file.h>
 #include <c4d_ccurve.h>
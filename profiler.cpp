@@ -0,0 +1,109 @@
+#include "profiler.hpp"
+#include "exporter.hpp"
+#include <dlib/json_writer.hpp>
+#include <psapi.h>
+
+#pragma comment(lib, "psapi.lib")
+
+//------------------------------------------------------------------------------
+static u64 PeakRss()
+{
+  PROCESS_MEMORY_COUNTERS counters;
+  if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+    return 0;
+  return counters.PeakWorkingSetSize;
+}
+
+//------------------------------------------------------------------------------
+void Profiler::Reset()
+{
+  stages.clear();
+  openStages.clear();
+  startTime = std::chrono::steady_clock::now();
+}
+
+//------------------------------------------------------------------------------
+double Profiler::Elapsed() const
+{
+  return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - startTime).count();
+}
+
+//------------------------------------------------------------------------------
+void Profiler::BeginStage(const char* name)
+{
+  Stage stage;
+  stage.name = name;
+  stage.depth = (int)openStages.size();
+  stage.start = Elapsed();
+  stage.duration = 0;
+  stage.peakRss = 0;
+  openStages.push_back((int)stages.size());
+  stages.push_back(stage);
+}
+
+//------------------------------------------------------------------------------
+void Profiler::EndStage()
+{
+  Stage& stage = stages[openStages.back()];
+  openStages.pop_back();
+  stage.duration = Elapsed() - stage.start;
+  stage.peakRss = PeakRss();
+}
+
+//------------------------------------------------------------------------------
+void Profiler::Log(const ExportInstance& instance) const
+{
+  instance.Log(2, "--> timings:\n");
+  for (const Stage& stage : stages)
+  {
+    instance.Log(2,
+        "    %*s%-*s %10.2f ms, peak rss %.2f MB\n",
+        stage.depth * 2,
+        "",
+        32 - stage.depth * 2,
+        stage.name.c_str(),
+        stage.duration / 1000,
+        stage.peakRss / (1024.0 * 1024.0));
+  }
+}
+
+//------------------------------------------------------------------------------
+bool Profiler::WriteChromeTrace(const string& filename) const
+{
+  // chrome://tracing or perfetto format. each stage is a complete event, and the peak rss a counter
+  JsonWriter w;
+  {
+    JsonWriter::JsonScope s(&w, JsonWriter::CompoundType::Object);
+    JsonWriter::JsonScope s2(&w, "traceEvents", JsonWriter::CompoundType::Array);
+    for (const Stage& stage : stages)
+    {
+      {
+        JsonWriter::JsonScope s(&w, JsonWriter::CompoundType::Object);
+        w.Emit("name", stage.name);
+        w.Emit("ph", "X");
+        w.Emit("ts", stage.start);
+        w.Emit("dur", stage.duration);
+        w.Emit("pid", 1);
+        w.Emit("tid", 1);
+      }
+
+      {
+        JsonWriter::JsonScope s(&w, JsonWriter::CompoundType::Object);
+        w.Emit("name", "peak rss (MB)");
+        w.Emit("ph", "C");
+        w.Emit("ts", stage.start + stage.duration);
+        w.Emit("pid", 1);
+        JsonWriter::JsonScope s2(&w, "args", JsonWriter::CompoundType::Object);
+        w.Emit("value", stage.peakRss / (1024.0 * 1024.0));
+      }
+    }
+  }
+
+  FILE* f = fopen(filename.c_str(), "wt");
+  if (!f)
+    return false;
+
+  fputs(w.res.c_str(), f);
+  fclose(f);
+  return true;
+}
@@ -0,0 +1,43 @@
+#pragma once
+#include <chrono>
+
+struct ExportInstance;
+
+//------------------------------------------------------------------------------
+// Wall time and memory use of the export stages. Stages can nest, and are stored in the order they
+// start, so the log and the trace read top down.
+struct Profiler
+{
+  struct Stage
+  {
+    string name;
+    int depth;
+    // in microseconds since the profiler was reset
+    double start;
+    double duration;
+    // the process peak working set when the stage ended. it's process wide, so with --jobs it also
+    // includes the other exports
+    u64 peakRss;
+  };
+
+  void Reset();
+  void BeginStage(const char* name);
+  void EndStage();
+  // microseconds since the profiler was reset
+  double Elapsed() const;
+
+  void Log(const ExportInstance& instance) const;
+  bool WriteChromeTrace(const string& filename) const;
+
+  vector<Stage> stages;
+  vector<int> openStages;
+  std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+};
+
+//------------------------------------------------------------------------------
+struct ScopedStage
+{
+  ScopedStage(Profiler* profiler, const char* name) : profiler(profiler) { profiler->BeginStage(name); }
+  ~ScopedStage() { profiler->EndStage(); }
+  Profiler* profiler;
+};
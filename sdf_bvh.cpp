@@ -0,0 +1,239 @@
+#include "sdf_bvh.hpp"
+
+namespace
+{
+#if WITH_SIMD_SDF
+  // a leaf is tested with a single call to the SIMD kernel
+  const u32 MAX_LEAF_TRIANGLES = SDF_SIMD_WIDTH;
+#else
+  const u32 MAX_LEAF_TRIANGLES = 4;
+#endif
+
+  //------------------------------------------------------------------------------
+  float DistSqToBox(const vec3& p, const vec3& minValue, const vec3& maxValue)
+  {
+    float dx = max(0.f, max(minValue.x - p.x, p.x - maxValue.x));
+    float dy = max(0.f, max(minValue.y - p.y, p.y - maxValue.y));
+    float dz = max(0.f, max(minValue.z - p.z, p.z - maxValue.z));
+    return dx * dx + dy * dy + dz * dz;
+  }
+
+  //------------------------------------------------------------------------------
+  float Component(const vec3& v, int axis)
+  {
+    return axis == 0 ? v.x : axis == 1 ? v.y : v.z;
+  }
+}
+
+//------------------------------------------------------------------------------
+void TriangleBvh::Build(const vector<ImMesh*>& meshes)
+{
+  triangles.clear();
+  nodes.clear();
+
+  for (u32 meshIdx = 0; meshIdx < (u32)meshes.size(); ++meshIdx)
+  {
+    const ImGeometry& geometry = meshes[meshIdx]->geometry;
+    const ImMeshVertex* verts = geometry.vertices.data();
+    for (u32 faceIdx = 0; faceIdx < (u32)geometry.faces.size(); ++faceIdx)
+    {
+      const ImMeshFace& face = geometry.faces[faceIdx];
+      triangles.push_back(Triangle{verts[face.a], verts[face.b], verts[face.c], meshIdx, faceIdx});
+    }
+  }
+
+  if (triangles.empty())
+    return;
+
+  vector<vec3> centroids(triangles.size());
+  for (size_t i = 0; i < triangles.size(); ++i)
+  {
+    const Triangle& t = triangles[i];
+    centroids[i] = (t.a + t.b + t.c) / 3;
+  }
+
+  nodes.reserve(2 * triangles.size() / MAX_LEAF_TRIANGLES + 1);
+  nodes.push_back(Node{vec3{0, 0, 0}, vec3{0, 0, 0}, 0, (u32)triangles.size()});
+  UpdateBounds(0);
+  Subdivide(0, &centroids);
+
+#if WITH_SIMD_SDF
+  soa.Resize(triangles.size());
+  for (size_t i = 0; i < triangles.size(); ++i)
+    soa.Set(i, triangles[i].a, triangles[i].b, triangles[i].c);
+#endif
+}
+
+//------------------------------------------------------------------------------
+void TriangleBvh::UpdateBounds(u32 nodeIdx)
+{
+  Node& node = nodes[nodeIdx];
+  node.minValue = vec3{+FLT_MAX, +FLT_MAX, +FLT_MAX};
+  node.maxValue = vec3{-FLT_MAX, -FLT_MAX, -FLT_MAX};
+  for (u32 i = node.leftOrFirst; i < node.leftOrFirst + node.count; ++i)
+  {
+    const Triangle& t = triangles[i];
+    node.minValue = Min(node.minValue, Min(t.a, Min(t.b, t.c)));
+    node.maxValue = Max(node.maxValue, Max(t.a, Max(t.b, t.c)));
+  }
+}
+
+//------------------------------------------------------------------------------
+void TriangleBvh::Subdivide(u32 nodeIdx, vector<vec3>* centroids)
+{
+  u32 first = nodes[nodeIdx].leftOrFirst;
+  u32 count = nodes[nodeIdx].count;
+  if (count <= MAX_LEAF_TRIANGLES)
+  {
+    // keep the leaf triangles in mesh/face order, so the first of several equally close triangles
+    // in a leaf is also the first in scene order
+    auto fnSceneOrder = [](const Triangle& lhs, const Triangle& rhs) {
+      return lhs.meshIdx < rhs.meshIdx || (lhs.meshIdx == rhs.meshIdx && lhs.faceIdx < rhs.faceIdx);
+    };
+    std::sort(triangles.begin() + first, triangles.begin() + first + count, fnSceneOrder);
+    return;
+  }
+
+  // split at the median centroid along the longest axis of the centroid bounds
+  vec3 minCentroid{+FLT_MAX, +FLT_MAX, +FLT_MAX};
+  vec3 maxCentroid{-FLT_MAX, -FLT_MAX, -FLT_MAX};
+  for (u32 i = first; i < first + count; ++i)
+  {
+    minCentroid = Min(minCentroid, (*centroids)[i]);
+    maxCentroid = Max(maxCentroid, (*centroids)[i]);
+  }
+
+  vec3 extents = maxCentroid - minCentroid;
+  int axis = extents.x > extents.y ? (extents.x > extents.z ? 0 : 2) : (extents.y > extents.z ? 1 : 2);
+
+  // sort an index list, and then permute the triangles and centroids to match
+  vector<u32> order(count);
+  for (u32 i = 0; i < count; ++i)
+    order[i] = first + i;
+
+  u32 mid = count / 2;
+  std::nth_element(order.begin(), order.begin() + mid, order.end(), [=](u32 lhs, u32 rhs) {
+    float a = Component((*centroids)[lhs], axis);
+    float b = Component((*centroids)[rhs], axis);
+    return a < b || (a == b && lhs < rhs);
+  });
+
+  vector<Triangle> tmpTriangles(count);
+  vector<vec3> tmpCentroids(count);
+  for (u32 i = 0; i < count; ++i)
+  {
+    tmpTriangles[i] = triangles[order[i]];
+    tmpCentroids[i] = (*centroids)[order[i]];
+  }
+  std::copy(tmpTriangles.begin(), tmpTriangles.end(), triangles.begin() + first);
+  std::copy(tmpCentroids.begin(), tmpCentroids.end(), centroids->begin() + first);
+
+  u32 leftIdx = (u32)nodes.size();
+  nodes.push_back(Node{vec3{0, 0, 0}, vec3{0, 0, 0}, first, mid});
+  nodes.push_back(Node{vec3{0, 0, 0}, vec3{0, 0, 0}, first + mid, count - mid});
+  nodes[nodeIdx].leftOrFirst = leftIdx;
+  nodes[nodeIdx].count = 0;
+
+  UpdateBounds(leftIdx);
+  UpdateBounds(leftIdx + 1);
+  Subdivide(leftIdx, centroids);
+  Subdivide(leftIdx + 1, centroids);
+}
+
+//------------------------------------------------------------------------------
+bool TriangleBvh::ClosestTriangle(const vec3& p, ClosestHit* hit) const
+{
+  if (nodes.empty())
+    return false;
+
+  // best-first traversal, always expanding the node closest to the query point, and stopping
+  // when the closest remaining node is further away than the closest triangle found so far
+  // the heap is kept per thread, so a query doesn't allocate once it has warmed up
+  typedef pair<float, u32> Candidate;
+  static thread_local vector<Candidate> heap;
+  heap.clear();
+  auto fnCmp = [](const Candidate& lhs, const Candidate& rhs) { return lhs.first > rhs.first; };
+
+  heap.push_back(Candidate{DistSqToBox(p, nodes[0].minValue, nodes[0].maxValue), 0});
+
+  ClosestHit best;
+  while (!heap.empty())
+  {
+    std::pop_heap(heap.begin(), heap.end(), fnCmp);
+    Candidate cur = heap.back();
+    heap.pop_back();
+
+    // nb, only stop on strictly further nodes, so triangles at the same distance can break the tie
+    if (cur.first > best.distSq)
+      break;
+
+    const Node& node = nodes[cur.second];
+    if (node.IsLeaf())
+    {
+#if WITH_SIMD_SDF
+      float d;
+      vec3 pt;
+      TriangleFeature feature;
+      int ofs = ClosestPtTrianglesSimd(p, soa, node.leftOrFirst, node.count, &d, &pt, &feature);
+      if (ofs != -1)
+      {
+        u32 i = node.leftOrFirst + ofs;
+        const Triangle& t = triangles[i];
+#else
+      for (u32 i = node.leftOrFirst; i < node.leftOrFirst + node.count; ++i)
+      {
+        const Triangle& t = triangles[i];
+        TriangleFeature feature;
+        vec3 pt = ClosestPtvec3Triangle(p, t.a, t.b, t.c, &feature);
+        float d = LengthSq(pt - p);
+#endif
+
+        // break ties on mesh/face order, so we pick the same triangle as a linear scan would
+        bool closer = d < best.distSq
+                      || (d == best.distSq
+                          && (t.meshIdx < best.meshIdx || (t.meshIdx == best.meshIdx && t.faceIdx < best.faceIdx)));
+        if (closer)
+        {
+          best.distSq = d;
+          best.pt = pt;
+          best.feature = feature;
+          best.triIdx = i;
+          best.meshIdx = t.meshIdx;
+          best.faceIdx = t.faceIdx;
+        }
+      }
+    }
+    else
+    {
+      for (u32 child = node.leftOrFirst; child < node.leftOrFirst + 2; ++child)
+      {
+        float d = DistSqToBox(p, nodes[child].minValue, nodes[child].maxValue);
+        if (d <= best.distSq)
+        {
+          heap.push_back(Candidate{d, child});
+          std::push_heap(heap.begin(), heap.end(), fnCmp);
+        }
+      }
+    }
+  }
+
+  *hit = best;
+  return best.triIdx != ~0u;
+}
+
+//------------------------------------------------------------------------------
+vec3 FeatureNormal(const ImGeometry& geometry, int faceIdx, TriangleFeature feature)
+{
+  const ImMeshFace& face = geometry.faces[faceIdx];
+
+  if (feature & FeatureVertex)
+  {
+    int ofs = feature - FeatureVertex;
+    return geometry.vertexNormals[face.vtx[ofs]];
+  }
+
+  if (feature & FeatureEdge)
+    return geometry.edgeNormals[faceIdx * 3 + (feature - FeatureEdge)];
+
+  return geometry.faceNormals[faceIdx];
+}
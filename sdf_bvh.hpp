@@ -0,0 +1,54 @@
+#pragma once
+#include "im_scene.hpp"
+#include "sdf_gen.hpp"
+#include "sdf_simd.hpp"
+
+//------------------------------------------------------------------------------
+// Bounding volume hierarchy over the world space triangles of all the meshes in the scene, used
+// to find the closest triangle to a point without testing every face.
+struct TriangleBvh
+{
+  struct Triangle
+  {
+    vec3 a, b, c;
+    u32 meshIdx;
+    u32 faceIdx;
+  };
+
+  struct Node
+  {
+    vec3 minValue;
+    vec3 maxValue;
+    // for leaves, the first triangle, otherwise the index of the left child (right is left + 1)
+    u32 leftOrFirst;
+    u32 count;
+
+    bool IsLeaf() const { return count > 0; }
+  };
+
+  struct ClosestHit
+  {
+    float distSq = FLT_MAX;
+    vec3 pt;
+    TriangleFeature feature = FeatureFace;
+    u32 triIdx = ~0u;
+    u32 meshIdx = ~0u;
+    u32 faceIdx = ~0u;
+  };
+
+  void Build(const vector<ImMesh*>& meshes);
+  bool ClosestTriangle(const vec3& p, ClosestHit* hit) const;
+
+  vector<Triangle> triangles;
+  vector<Node> nodes;
+#if WITH_SIMD_SDF
+  // copy of the triangles, in the same order, for the SIMD leaf test
+  TriangleSoA soa;
+#endif
+
+private:
+  void Subdivide(u32 nodeIdx, vector<vec3>* centroids);
+  void UpdateBounds(u32 nodeIdx);
+};
+
+vec3 FeatureNormal(const ImGeometry& geometry, int faceIdx, TriangleFeature feature);
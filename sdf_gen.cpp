@@ -2,86 +2,15 @@
 #include <dlib/json_writer.hpp>
 #include "exporter_utils.hpp"
 #include "sdf_gen.hpp"
+#include "sdf_bvh.hpp"
+#include "parallel.hpp"
 #include "bit_utils.hpp"
 
 #if WITH_EMBREE
 #include <c:/projects/embree/common/math/affinespace.h>
 #endif
 #include "contrib/sdf/makelevelset3.h"
-
-extern vector<char> buffer;
-
-vec3 ClosestPtvec3Triangle(
-    const vec3& p, const vec3& a, const vec3& b, const vec3& c, TriangleFeature* feature)
-{
-
-  // Check if P in vertex region outside A
-  vec3 ab = b - a;
-  vec3 ac = c - a;
-  vec3 ap = p - a;
-  float d1 = Dot(ab, ap);
-  float d2 = Dot(ac, ap);
-  if (d1 <= 0.0f && d2 <= 0.0f)
-  {
-    *feature = FeatureVertexA;
-    return a; // barycentric coordinates (1,0,0)
-  }
-
-  // Check if P in vertex region outside B
-  vec3 bp = p - b;
-  float d3 = Dot(ab, bp);
-  float d4 = Dot(ac, bp);
-  if (d3 >= 0.0f && d4 <= d3)
-  {
-    *feature = FeatureVertexB;
-    return b; // barycentric coordinates (0,1,0)
-  }
-
-  // Check if P in edge region of AB, if so return projection of P onto AB
-  float vc = d1 * d4 - d3 * d2;
-  if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f)
-  {
-    *feature = FeatureEdgeAB;
-    float v = d1 / (d1 - d3);
-    return a + v * ab; // barycentric coordinates (1-v,v,0)
-  }
-
-  // Check if P in vertex region outside C
-  vec3 cp = p - c;
-  float d5 = Dot(ab, cp);
-  float d6 = Dot(ac, cp);
-  if (d6 >= 0.0f && d5 <= d6)
-  {
-    *feature = FeatureVertexC;
-    return c; // barycentric coordinates (0,0,1)
-  }
-
-  // Check if P in edge region of AC, if so return projection of P onto AC
-  float vb = d5 * d2 - d1 * d6;
-  if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f)
-  {
-    *feature = FeatureEdgeAC;
-    float w = d2 / (d2 - d6);
-    return a + w * ac; // barycentric coordinates (1-w,0,w)
-  }
-
-  // Check if P in edge region of BC, if so return projection of P onto BC
-  float va = d3 * d6 - d5 * d4;
-  if (va <= 0.0f && (d4 - d3) >= 0.0f && (d5 - d6) >= 0.0f)
-  {
-    *feature = FeatureEdgeBC;
-    float w = (d4 - d3) / ((d4 - d3) + (d5 - d6));
-    return b + w * (c - b); // barycentric coordinates (0,1-w,w)
-  }
-
-  *feature = FeatureFace;
-  // P inside face region. Compute Q through its barycentric coordinates (u,v,w)
-  float denom = 1.0f / (va + vb + vc);
-  float v = vb * denom;
-  float w = vc * denom;
-  return a + ab * v + ac * w; // = u*a + v*b + w*c, u = va * denom = 1.0f - v - w
-}
-
+#include "compress/snorm.h"
 
 #if WITH_EMBREE
 //------------------------------------------------------------------------------
@@ -138,7 +67,7 @@ static bool TrianglesFromMesh(const ImMesh* mesh, vector<ImMeshFace>* triangles,
 }
 
 //------------------------------------------------------------------------------
-static void CreateSDF(const ImScene& scene, const Options& options, JsonWriter* w)
+static void CreateSDF(const ImScene& scene, const Options& options, vector<char>* buffer, JsonWriter* w)
 {
   using melange::Vector;
 
@@ -301,10 +230,10 @@ static void CreateSDF(const ImScene& scene, const Options& options, JsonWriter*
   rtcDeleteScene(rtcScene);
   rtcDeleteDevice(rtcDevice);
 
-  size_t oldSize = buffer.size();
+  size_t oldSize = buffer->size();
   size_t dataSize = sdf.size() * sizeof(float);
-  buffer.resize(oldSize + dataSize);
-  memcpy(buffer.data() + oldSize, sdf.data(), dataSize);
+  buffer->resize(oldSize + dataSize);
+  memcpy(buffer->data() + oldSize, sdf.data(), dataSize);
 
   JsonWriter::JsonScope s(w, "sdf", JsonWriter::CompoundType::Object);
   w->Emit("dataOffset", oldSize);
@@ -381,7 +310,7 @@ static bool TrianglesFromMesh2(
 }
 
 //------------------------------------------------------------------------------
-static void CreateSDF2(const ExportInstance& instance, JsonWriter* w)
+static void CreateSDF2(const ExportInstance& instance, vector<char>* buffer, JsonWriter* w)
 {
   using melange::Vector;
 
@@ -445,10 +374,10 @@ static void CreateSDF2(const ExportInstance& instance, JsonWriter* w)
     printf("\n");
   }
 
-  size_t oldSize = buffer.size();
+  size_t oldSize = buffer->size();
   size_t dataSize = sdf.a.size() * sizeof(float);
-  buffer.resize(oldSize + dataSize);
-  memcpy(buffer.data() + oldSize, sdf.a.data(), dataSize);
+  buffer->resize(oldSize + dataSize);
+  memcpy(buffer->data() + oldSize, sdf.a.data(), dataSize);
 
   JsonWriter::JsonScope s(w, "sdf", JsonWriter::CompoundType::Object);
   w->Emit("dataOffset", oldSize);
@@ -459,29 +388,58 @@ static void CreateSDF2(const ExportInstance& instance, JsonWriter* w)
 }
 
 //------------------------------------------------------------------------------
-void JsonExporter::CreateSDF3(JsonWriter* w)
+static bool ClosestTriangleBruteForce(
+    const vector<ImMesh*>& meshes, const vec3& p, TriangleBvh::ClosestHit* hit)
 {
-  using melange::Vector;
+  TriangleBvh::ClosestHit best;
+  for (u32 meshIdx = 0; meshIdx < (u32)meshes.size(); ++meshIdx)
+  {
+    const ImGeometry& geometry = meshes[meshIdx]->geometry;
+    const ImMeshVertex* verts = geometry.vertices.data();
 
-  size_t gridRes = instance->options.gridSize;
-  vector<float> sdf(gridRes*gridRes*gridRes);
+    for (u32 faceIdx = 0; faceIdx < (u32)geometry.faces.size(); ++faceIdx)
+    {
+      const ImMeshFace& face = geometry.faces[faceIdx];
+      TriangleFeature feature;
+      vec3 pt = ClosestPtvec3Triangle(p, verts[face.a], verts[face.b], verts[face.c], &feature);
+      float d = LengthSq(pt - p);
+      if (d < best.distSq)
+      {
+        best.distSq = d;
+        best.pt = pt;
+        best.feature = feature;
+        best.meshIdx = meshIdx;
+        best.faceIdx = faceIdx;
+      }
+    }
+  }
 
-  vec3 minPos = instance->scene->boundingBox.minValue;
-  vec3 maxPos = instance->scene->boundingBox.maxValue;
-  vec3 span = maxPos - minPos;
-  minPos = minPos - 0.05f * span;
-  maxPos = maxPos + 0.05f * span;
+  *hit = best;
+  return best.meshIdx != ~0u;
+}
 
-  //minPos = vec3{-200, -200, -200};
-  //maxPos = vec3{+200, +200, +200};
+//------------------------------------------------------------------------------
+static void CreateSDFClosestPoint(
+    const ExportInstance& instance, const vec3& minPos, const vec3& inc, size_t gridRes, vector<float>* sdf)
+{
+  const vector<ImMesh*>& meshes = instance.scene->meshes;
+  bool bruteForce = instance.options.sdfMethod == SdfMethod::Brute;
+
+  TriangleBvh bvh;
+  if (!bruteForce)
+  {
+    bvh.Build(meshes);
+    instance.Log(2, "SDF bvh: %d triangles, %d nodes\n", (int)bvh.triangles.size(), (int)bvh.nodes.size());
+  }
 
   vec3 bottomLeft = minPos;
-  vec3 cur = bottomLeft;
-  vec3 inc = (maxPos - minPos) / (float)(gridRes - 1);
 
-  for (size_t i = 0; i < gridRes; ++i)
-  {
-    cur.y = bottomLeft.y;
+  // each z-slice is evaluated independently, and writes to its own part of the grid, so the
+  // output doesn't depend on the number of threads
+  int numThreads = NumWorkerThreads(instance.options.threads);
+  ParallelFor((int)gridRes, numThreads, [&](int i) {
+    vec3 cur = bottomLeft;
+    cur.z = bottomLeft.z + i * inc.z;
     for (size_t j = 0; j < gridRes; ++j)
     {
       cur.x = bottomLeft.x;
@@ -490,83 +448,323 @@ void JsonExporter::CreateSDF3(JsonWriter* w)
         float closestDistance = FLT_MAX;
         vec3 closestPt, closestNormal;
 
-        for (const ImMesh* mesh : instance->scene->meshes)
+        TriangleBvh::ClosestHit hit;
+        bool found =
+            bruteForce ? ClosestTriangleBruteForce(meshes, cur, &hit) : bvh.ClosestTriangle(cur, &hit);
+        if (found)
         {
-          const ImMeshVertex* verts = mesh->geometry.vertices.data();
-
-          for (size_t faceIdx = 0; faceIdx < mesh->geometry.faces.size(); ++faceIdx)
-          {
-            const ImMeshFace& face = mesh->geometry.faces[faceIdx];
-            TriangleFeature feature;
-            vec3 pt = ClosestPtvec3Triangle(cur, verts[face.a], verts[face.b], verts[face.c], &feature);
-            float d = LengthSq(pt - cur);
-            if (d < closestDistance)
-            {
-              // use feature normal to determine inside/outside
-              closestDistance = d;
-              closestPt = pt;
-
-              if (feature & FeatureVertex)
-              {
-                int ofs = feature - FeatureVertex;
-                closestNormal = mesh->geometry.vertexNormals[face.vtx[ofs]];
-              }
-              else if (feature & FeatureEdge)
-              {
-                int a, b;
-                if (feature == FeatureEdgeAB)
-                {
-                  a = face.a;
-                  b = face.b;
-                }
-                else if (feature == FeatureEdgeAC)
-                {
-                  a = face.a;
-                  b = face.c;
-                }
-                else
-                {
-                  // BC
-                  a = face.b;
-                  b = face.c;
-                }
-                pair<int, int> edge = make_pair(min(a, b), max(a, b));
-                auto it = mesh->geometry.edgeNormals.find(edge);
-                if (it != mesh->geometry.edgeNormals.end())
-                {
-                  closestNormal = it->second;
-                }
-                else
-                {
-                  instance->Log(1, "Unable to find edge: %d - %d\n", a, b);
-                }
-
-              }
-              else
-              {
-                closestNormal = mesh->geometry.faceNormals[faceIdx];
-              }
-            }
-          }
+          // use feature normal to determine inside/outside
+          closestDistance = hit.distSq;
+          closestPt = hit.pt;
+          closestNormal = FeatureNormal(meshes[hit.meshIdx]->geometry, hit.faceIdx, hit.feature);
         }
 
         closestDistance = sqrtf(closestDistance);
         // check if the current point is behind the closest point (inside the shape)
         float dot = Dot(Normalize(cur - closestPt), closestNormal);
         float mul = dot < 0 ? -1 : 1;
-        sdf[i*gridRes*gridRes + j*gridRes + k] = mul * sqrtf(closestDistance);
+        (*sdf)[i*gridRes*gridRes + j*gridRes + k] = mul * closestDistance;
 
         cur.x += inc.x;
       }
 
       cur.y += inc.y;
     }
+  });
+}
+
+//------------------------------------------------------------------------------
+static void CreateSDFSweep(
+    const ExportInstance& instance, const vec3& minPos, const vec3& inc, size_t gridRes, vector<float>* sdf)
+{
+  // collect all the world space triangles
+  vector<Vec3ui> triangles;
+  vector<Vec3f> vertices;
+  for (const ImMesh* mesh : instance.scene->meshes)
+  {
+    unsigned int vertexOfs = (unsigned int)vertices.size();
+    for (const ImMeshVertex& v : mesh->geometry.vertices)
+      vertices.push_back(Vec3f{v.x, v.y, v.z});
+
+    for (const ImMeshFace& face : mesh->geometry.faces)
+      triangles.push_back(Vec3ui{face.a + vertexOfs, face.b + vertexOfs, face.c + vertexOfs});
+  }
+
+  // make_level_set3 uses a cell size of (max - min) / res, so extend the max to get the same
+  // sample positions as the closest point methods
+  vec3 maxPos = minPos + (float)gridRes * inc;
+  int res = (int)gridRes;
+
+  Array3f phi;
+  make_level_set3(
+      triangles,
+      vertices,
+      Vec3f{minPos.x, minPos.y, minPos.z},
+      Vec3f{maxPos.x, maxPos.y, maxPos.z},
+      Vec3i{res, res, res},
+      phi,
+      instance.options.sdfExactBand);
+
+  // phi is indexed as x + y * res + z * res * res, which matches our layout
+  *sdf = phi.a;
+}
+
+//------------------------------------------------------------------------------
+static const int SDF_BRICK_SIZE = 8;
+
+struct SdfBricks
+{
+  // number of bricks along each axis
+  int brickRes = 0;
+  // per brick, the index into the brick data, or one of the far values below
+  vector<int> brickMap;
+  // SDF_BRICK_SIZE^3 cells per brick, stored as (SDF_BRICK_SIZE+1)^3 samples so each brick can be
+  // filtered without looking at its neighbours
+  vector<float> data;
+  float farValue = 0;
+  int numBricks = 0;
+
+  enum { FarOutside = -1, FarInside = -2 };
+};
+
+//------------------------------------------------------------------------------
+static void CreateSDFBricks(const vector<float>& sdf, size_t gridRes, const vec3& inc, SdfBricks* bricks)
+{
+  // a brick is kept if any of its samples are within the brick diagonal of the surface. everything
+  // else is at least that far away, and is replaced by a clamped far value
+  int numCells = (int)gridRes - 1;
+  int brickRes = (numCells + SDF_BRICK_SIZE - 1) / SDF_BRICK_SIZE;
+  float maxInc = max(inc.x, max(inc.y, inc.z));
+  float band = sqrtf(3.0f) * SDF_BRICK_SIZE * maxInc;
+
+  bricks->brickRes = brickRes;
+  bricks->farValue = band;
+  bricks->brickMap.resize(brickRes * brickRes * brickRes);
+  bricks->data.clear();
+  bricks->numBricks = 0;
+
+  const int samplesPerAxis = SDF_BRICK_SIZE + 1;
+  vector<float> samples(samplesPerAxis * samplesPerAxis * samplesPerAxis);
+
+  for (int bz = 0; bz < brickRes; ++bz)
+  {
+    for (int by = 0; by < brickRes; ++by)
+    {
+      for (int bx = 0; bx < brickRes; ++bx)
+      {
+        // gather the brick samples, clamping to the grid on the last brick along each axis
+        float minAbs = FLT_MAX;
+        int idx = 0;
+        for (int z = 0; z < samplesPerAxis; ++z)
+        {
+          size_t gz = min<size_t>(bz * SDF_BRICK_SIZE + z, gridRes - 1);
+          for (int y = 0; y < samplesPerAxis; ++y)
+          {
+            size_t gy = min<size_t>(by * SDF_BRICK_SIZE + y, gridRes - 1);
+            for (int x = 0; x < samplesPerAxis; ++x)
+            {
+              size_t gx = min<size_t>(bx * SDF_BRICK_SIZE + x, gridRes - 1);
+              float d = sdf[gz * gridRes * gridRes + gy * gridRes + gx];
+              samples[idx++] = d;
+              minAbs = min(minAbs, fabsf(d));
+            }
+          }
+        }
+
+        int& entry = bricks->brickMap[bz * brickRes * brickRes + by * brickRes + bx];
+        if (minAbs > band)
+        {
+          // no sample is near the surface, so the brick can't straddle it, and all samples share a sign
+          entry = samples[0] < 0 ? SdfBricks::FarInside : SdfBricks::FarOutside;
+          continue;
+        }
+
+        entry = bricks->numBricks++;
+        bricks->data.insert(bricks->data.end(), samples.begin(), samples.end());
+      }
+    }
+  }
+}
+
+//------------------------------------------------------------------------------
+static int DedupSDFBricks(vector<int>* brickMap, vector<char>* data, int numBricks)
+{
+  // bricks that are identical after quantization are stored once, and the brick map entries all point
+  // at the first copy. returns the number of unique bricks
+  if (numBricks == 0)
+    return 0;
+
+  size_t brickSize = data->size() / numBricks;
+  std::unordered_multimap<u64, int> bricksByHash;
+  vector<int> remap(numBricks);
+  int numUnique = 0;
+  for (int i = 0; i < numBricks; ++i)
+  {
+    const char* src = data->data() + i * brickSize;
+    u64 hash = FnvHash64(src, brickSize);
+    remap[i] = -1;
+    auto range = bricksByHash.equal_range(hash);
+    for (auto it = range.first; it != range.second; ++it)
+    {
+      if (memcmp(data->data() + it->second * brickSize, src, brickSize) == 0)
+      {
+        remap[i] = it->second;
+        break;
+      }
+    }
 
-    cur.z += inc.z;
+    if (remap[i] != -1)
+      continue;
+
+    // compact in place, the unique bricks never overtake the one being read
+    if (numUnique != i)
+      memcpy(data->data() + numUnique * brickSize, src, brickSize);
+    bricksByHash.insert(make_pair(hash, numUnique));
+    remap[i] = numUnique++;
+  }
+
+  data->resize(numUnique * brickSize);
+  for (int& entry : *brickMap)
+  {
+    if (entry >= 0)
+      entry = remap[entry];
+  }
+  return numUnique;
+}
+
+//------------------------------------------------------------------------------
+template <int Bits, typename T>
+static void QuantizeSDFSnorm(const vector<float>& values, float range, vector<char>* out, float* maxError)
+{
+  out->resize(values.size() * sizeof(T));
+  T* dst = (T*)out->data();
+  *maxError = 0;
+  for (size_t i = 0; i < values.size(); ++i)
+  {
+    Snorm<Bits> q(values[i] / range);
+    dst[i] = (T)q.bits();
+    // only the error inside the range is interesting, everything outside it is clamped by design
+    if (fabsf(values[i]) <= range)
+      *maxError = max(*maxError, fabsf((float)q * range - values[i]));
+  }
+}
+
+//------------------------------------------------------------------------------
+static float QuantizeSDF(
+    const ExportInstance& instance, const vector<float>& values, vector<char>* out, float* maxError)
+{
+  // returns the range the values are normalized against
+  const Options& options = instance.options;
+  float range = options.sdfTruncation;
+  if (range <= 0)
+  {
+    range = 0;
+    for (float v : values)
+      range = max(range, fabsf(v));
+    range = max(range, FLT_MIN);
   }
 
+  *maxError = 0;
+  switch (options.sdfFormat)
+  {
+    case SdfFormat::Snorm8:
+    {
+      QuantizeSDFSnorm<8, int8_t>(values, range, out, maxError);
+      break;
+    }
+    case SdfFormat::Snorm16:
+    {
+      QuantizeSDFSnorm<16, int16_t>(values, range, out, maxError);
+      break;
+    }
+    default:
+    {
+      out->resize(values.size() * sizeof(float));
+      memcpy(out->data(), values.data(), out->size());
+      break;
+    }
+  }
+  return range;
+}
+
+//------------------------------------------------------------------------------
+void JsonExporter::CreateSDF3(JsonWriter* w)
+{
+  size_t gridRes = instance->options.gridSize;
+  vector<float> sdf(gridRes*gridRes*gridRes);
+
+  vec3 minPos = instance->scene->boundingBox.minValue;
+  vec3 maxPos = instance->scene->boundingBox.maxValue;
+  vec3 span = maxPos - minPos;
+  minPos = minPos - 0.05f * span;
+  maxPos = maxPos + 0.05f * span;
+
+  //minPos = vec3{-200, -200, -200};
+  //maxPos = vec3{+200, +200, +200};
+
+  vec3 inc = (maxPos - minPos) / (float)(gridRes - 1);
+
+  {
+    ScopedStage stage(&instance->profiler, "generate distances");
+    if (instance->options.sdfMethod == SdfMethod::Sweep)
+      CreateSDFSweep(*instance, minPos, inc, gridRes, &sdf);
+    else
+      CreateSDFClosestPoint(*instance, minPos, inc, gridRes, &sdf);
+  }
+
+  static const char* formatNames[] = { "float", "snorm8", "snorm16" };
+  const Options& options = instance->options;
+
+  vector<char> data;
+  float maxError = 0;
+  auto fnQuantize = [&](const vector<float>& values) {
+    float range = QuantizeSDF(*instance, values, &data, &maxError);
+    if (options.sdfReportError && options.sdfFormat != SdfFormat::Float)
+    {
+      instance->Log(1,
+          "SDF %s: max error %f (%.3f%% of range %f)\n",
+          formatNames[(int)options.sdfFormat],
+          maxError,
+          100 * maxError / range,
+          range);
+    }
+    return range;
+  };
+
   JsonWriter::JsonScope s(w, "sdf", JsonWriter::CompoundType::Object);
-  AddToBuffer(sdf, "data", w);
+  w->Emit("format", formatNames[(int)options.sdfFormat]);
+  if (options.sdfBricks)
+  {
+    SdfBricks bricks;
+    CreateSDFBricks(sdf, gridRes, inc, &bricks);
+    float range = fnQuantize(bricks.data);
+    int numKept = bricks.numBricks;
+    bricks.numBricks = DedupSDFBricks(&bricks.brickMap, &data, bricks.numBricks);
+
+    size_t denseSize = sdf.size() * sizeof(float);
+    size_t sparseSize = bricks.brickMap.size() * sizeof(int) + data.size();
+    instance->Log(2,
+        "SDF bricks: %d of %d kept, %d unique, %.2f MB -> %.2f MB\n",
+        numKept,
+        (int)bricks.brickMap.size(),
+        bricks.numBricks,
+        denseSize / (1024.0f * 1024.0f),
+        sparseSize / (1024.0f * 1024.0f));
+
+    JsonWriter::JsonScope s(w, "bricks", JsonWriter::CompoundType::Object);
+    w->Emit("brickSize", SDF_BRICK_SIZE);
+    w->Emit("brickRes", bricks.brickRes);
+    w->Emit("numBricks", bricks.numBricks);
+    w->Emit("farValue", bricks.farValue);
+    w->Emit("range", range);
+    AddToBuffer(bricks.brickMap, "brickMap", DatSectionType::Sdf, w);
+    AddToBuffer(data, "data", DatSectionType::Sdf, w);
+  }
+  else
+  {
+    w->Emit("range", fnQuantize(sdf));
+    AddToBuffer(data, "data", DatSectionType::Sdf, w);
+  }
   w->Emit("gridRes", gridRes);
   w->EmitArray("gridMin", { minPos.x, minPos.y, minPos.z });
   w->EmitArray("gridMax", { maxPos.x, maxPos.y, maxPos.z });
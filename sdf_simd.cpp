@@ -0,0 +1,248 @@
+#include "sdf_simd.hpp"
+#include <immintrin.h>
+
+namespace
+{
+#if defined(__AVX2__)
+  typedef __m256 simd;
+  inline simd Load(const float* p) { return _mm256_loadu_ps(p); }
+  inline void Store(float* p, simd a) { _mm256_storeu_ps(p, a); }
+  inline simd Set1(float v) { return _mm256_set1_ps(v); }
+  inline simd Add(simd a, simd b) { return _mm256_add_ps(a, b); }
+  inline simd Sub(simd a, simd b) { return _mm256_sub_ps(a, b); }
+  inline simd Mul(simd a, simd b) { return _mm256_mul_ps(a, b); }
+  inline simd Div(simd a, simd b) { return _mm256_div_ps(a, b); }
+  inline simd And(simd a, simd b) { return _mm256_and_ps(a, b); }
+  inline simd CmpLe(simd a, simd b) { return _mm256_cmp_ps(a, b, _CMP_LE_OQ); }
+  inline simd CmpGe(simd a, simd b) { return _mm256_cmp_ps(a, b, _CMP_GE_OQ); }
+  // returns b where mask is set, otherwise a
+  inline simd Select(simd a, simd b, simd mask) { return _mm256_blendv_ps(a, b, mask); }
+#else
+  typedef __m128 simd;
+  inline simd Load(const float* p) { return _mm_loadu_ps(p); }
+  inline void Store(float* p, simd a) { _mm_storeu_ps(p, a); }
+  inline simd Set1(float v) { return _mm_set1_ps(v); }
+  inline simd Add(simd a, simd b) { return _mm_add_ps(a, b); }
+  inline simd Sub(simd a, simd b) { return _mm_sub_ps(a, b); }
+  inline simd Mul(simd a, simd b) { return _mm_mul_ps(a, b); }
+  inline simd Div(simd a, simd b) { return _mm_div_ps(a, b); }
+  inline simd And(simd a, simd b) { return _mm_and_ps(a, b); }
+  inline simd CmpLe(simd a, simd b) { return _mm_cmple_ps(a, b); }
+  inline simd CmpGe(simd a, simd b) { return _mm_cmpge_ps(a, b); }
+  // returns b where mask is set, otherwise a
+  inline simd Select(simd a, simd b, simd mask) { return _mm_or_ps(_mm_and_ps(mask, b), _mm_andnot_ps(mask, a)); }
+#endif
+
+  //------------------------------------------------------------------------------
+  struct simd3
+  {
+    simd x, y, z;
+  };
+
+  inline simd3 Sub(const simd3& a, const simd3& b) { return simd3{Sub(a.x, b.x), Sub(a.y, b.y), Sub(a.z, b.z)}; }
+  inline simd3 Add(const simd3& a, const simd3& b) { return simd3{Add(a.x, b.x), Add(a.y, b.y), Add(a.z, b.z)}; }
+  inline simd3 Mul(simd s, const simd3& v) { return simd3{Mul(s, v.x), Mul(s, v.y), Mul(s, v.z)}; }
+  inline simd Dot(const simd3& a, const simd3& b) { return Add(Add(Mul(a.x, b.x), Mul(a.y, b.y)), Mul(a.z, b.z)); }
+
+  inline simd3 Select(const simd3& a, const simd3& b, simd mask)
+  {
+    return simd3{Select(a.x, b.x, mask), Select(a.y, b.y, mask), Select(a.z, b.z, mask)};
+  }
+}
+
+//------------------------------------------------------------------------------
+void TriangleSoA::Resize(size_t numTriangles)
+{
+  size = numTriangles;
+  for (vector<float>* v : {&ax, &ay, &az, &bx, &by, &bz, &cx, &cy, &cz})
+    v->assign(numTriangles + SDF_SIMD_WIDTH, 0.f);
+}
+
+//------------------------------------------------------------------------------
+void TriangleSoA::Set(size_t idx, const vec3& a, const vec3& b, const vec3& c)
+{
+  ax[idx] = a.x;
+  ay[idx] = a.y;
+  az[idx] = a.z;
+  bx[idx] = b.x;
+  by[idx] = b.y;
+  bz[idx] = b.z;
+  cx[idx] = c.x;
+  cy[idx] = c.y;
+  cz[idx] = c.z;
+}
+
+//------------------------------------------------------------------------------
+vec3 ClosestPtvec3Triangle(
+    const vec3& p, const vec3& a, const vec3& b, const vec3& c, TriangleFeature* feature)
+{
+  // ClosestPtTrianglesSimd below does the same operations in the same order, so keep them in sync
+
+  // Check if P in vertex region outside A
+  vec3 ab = b - a;
+  vec3 ac = c - a;
+  vec3 ap = p - a;
+  float d1 = Dot(ab, ap);
+  float d2 = Dot(ac, ap);
+  if (d1 <= 0.0f && d2 <= 0.0f)
+  {
+    *feature = FeatureVertexA;
+    return a; // barycentric coordinates (1,0,0)
+  }
+
+  // Check if P in vertex region outside B
+  vec3 bp = p - b;
+  float d3 = Dot(ab, bp);
+  float d4 = Dot(ac, bp);
+  if (d3 >= 0.0f && d4 <= d3)
+  {
+    *feature = FeatureVertexB;
+    return b; // barycentric coordinates (0,1,0)
+  }
+
+  // Check if P in edge region of AB, if so return projection of P onto AB
+  float vc = d1 * d4 - d3 * d2;
+  if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f)
+  {
+    *feature = FeatureEdgeAB;
+    float v = d1 / (d1 - d3);
+    return a + v * ab; // barycentric coordinates (1-v,v,0)
+  }
+
+  // Check if P in vertex region outside C
+  vec3 cp = p - c;
+  float d5 = Dot(ab, cp);
+  float d6 = Dot(ac, cp);
+  if (d6 >= 0.0f && d5 <= d6)
+  {
+    *feature = FeatureVertexC;
+    return c; // barycentric coordinates (0,0,1)
+  }
+
+  // Check if P in edge region of AC, if so return projection of P onto AC
+  float vb = d5 * d2 - d1 * d6;
+  if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f)
+  {
+    *feature = FeatureEdgeAC;
+    float w = d2 / (d2 - d6);
+    return a + w * ac; // barycentric coordinates (1-w,0,w)
+  }
+
+  // Check if P in edge region of BC, if so return projection of P onto BC
+  float va = d3 * d6 - d5 * d4;
+  if (va <= 0.0f && (d4 - d3) >= 0.0f && (d5 - d6) >= 0.0f)
+  {
+    *feature = FeatureEdgeBC;
+    float w = (d4 - d3) / ((d4 - d3) + (d5 - d6));
+    return b + w * (c - b); // barycentric coordinates (0,1-w,w)
+  }
+
+  *feature = FeatureFace;
+  // P inside face region. Compute Q through its barycentric coordinates (u,v,w)
+  float denom = 1.0f / (va + vb + vc);
+  float v = vb * denom;
+  float w = vc * denom;
+  return a + ab * v + ac * w; // = u*a + v*b + w*c, u = va * denom = 1.0f - v - w
+}
+
+//------------------------------------------------------------------------------
+int ClosestPtTrianglesSimd(
+    const vec3& p,
+    const TriangleSoA& tris,
+    size_t first,
+    int count,
+    float* distSq,
+    vec3* pt,
+    TriangleFeature* feature)
+{
+  // This is ClosestPtvec3Triangle evaluated for all the regions at once, using the same operations
+  // in the same order, and then picking the result for the first region that matches.
+  simd3 pp{Set1(p.x), Set1(p.y), Set1(p.z)};
+  simd3 a{Load(&tris.ax[first]), Load(&tris.ay[first]), Load(&tris.az[first])};
+  simd3 b{Load(&tris.bx[first]), Load(&tris.by[first]), Load(&tris.bz[first])};
+  simd3 c{Load(&tris.cx[first]), Load(&tris.cy[first]), Load(&tris.cz[first])};
+  simd zero = Set1(0.f);
+
+  simd3 ab = Sub(b, a);
+  simd3 ac = Sub(c, a);
+  simd3 ap = Sub(pp, a);
+  simd d1 = Dot(ab, ap);
+  simd d2 = Dot(ac, ap);
+
+  simd3 bp = Sub(pp, b);
+  simd d3 = Dot(ab, bp);
+  simd d4 = Dot(ac, bp);
+
+  simd3 cp = Sub(pp, c);
+  simd d5 = Dot(ab, cp);
+  simd d6 = Dot(ac, cp);
+
+  simd vc = Sub(Mul(d1, d4), Mul(d3, d2));
+  simd vb = Sub(Mul(d5, d2), Mul(d1, d6));
+  simd va = Sub(Mul(d3, d6), Mul(d5, d4));
+
+  simd d43 = Sub(d4, d3);
+  simd d56 = Sub(d5, d6);
+
+  simd maskA = And(CmpLe(d1, zero), CmpLe(d2, zero));
+  simd maskB = And(CmpGe(d3, zero), CmpLe(d4, d3));
+  simd maskAB = And(And(CmpLe(vc, zero), CmpGe(d1, zero)), CmpLe(d3, zero));
+  simd maskC = And(CmpGe(d6, zero), CmpLe(d5, d6));
+  simd maskAC = And(And(CmpLe(vb, zero), CmpGe(d2, zero)), CmpLe(d6, zero));
+  simd maskBC = And(And(CmpLe(va, zero), CmpGe(d43, zero)), CmpGe(d56, zero));
+
+  // face region
+  simd denom = Div(Set1(1.f), Add(Add(va, vb), vc));
+  simd3 res = Add(Add(a, Mul(Mul(vb, denom), ab)), Mul(Mul(vc, denom), ac));
+  simd feat = Set1((float)FeatureFace);
+
+  // blend in the other regions in reverse order of precedence, so the first match wins
+  res = Select(res, Add(b, Mul(Div(d43, Add(d43, d56)), Sub(c, b))), maskBC);
+  feat = Select(feat, Set1((float)FeatureEdgeBC), maskBC);
+
+  res = Select(res, Add(a, Mul(Div(d2, Sub(d2, d6)), ac)), maskAC);
+  feat = Select(feat, Set1((float)FeatureEdgeAC), maskAC);
+
+  res = Select(res, c, maskC);
+  feat = Select(feat, Set1((float)FeatureVertexC), maskC);
+
+  res = Select(res, Add(a, Mul(Div(d1, Sub(d1, d3)), ab)), maskAB);
+  feat = Select(feat, Set1((float)FeatureEdgeAB), maskAB);
+
+  res = Select(res, b, maskB);
+  feat = Select(feat, Set1((float)FeatureVertexB), maskB);
+
+  res = Select(res, a, maskA);
+  feat = Select(feat, Set1((float)FeatureVertexA), maskA);
+
+  simd3 delta = Sub(res, pp);
+  simd dist = Dot(delta, delta);
+
+  float laneDist[SDF_SIMD_WIDTH], laneFeat[SDF_SIMD_WIDTH];
+  float laneX[SDF_SIMD_WIDTH], laneY[SDF_SIMD_WIDTH], laneZ[SDF_SIMD_WIDTH];
+  Store(laneDist, dist);
+  Store(laneFeat, feat);
+  Store(laneX, res.x);
+  Store(laneY, res.y);
+  Store(laneZ, res.z);
+
+  // nb, written so lanes with NaN distances (from degenerate triangles) are never picked
+  int best = -1;
+  float bestDist = FLT_MAX;
+  for (int i = 0; i < count; ++i)
+  {
+    if (laneDist[i] < bestDist)
+    {
+      best = i;
+      bestDist = laneDist[i];
+    }
+  }
+
+  if (best == -1)
+    return -1;
+
+  *distSq = laneDist[best];
+  *pt = vec3{laneX[best], laneY[best], laneZ[best]};
+  *feature = (TriangleFeature)(int)laneFeat[best];
+  return best;
+}
@@ -0,0 +1,38 @@
+#pragma once
+#include "sdf_gen.hpp"
+
+// Set to 0 to use the scalar ClosestPtvec3Triangle for the SDF closest-point queries
+#define WITH_SIMD_SDF 1
+
+#if defined(__AVX2__)
+static const int SDF_SIMD_WIDTH = 8;
+#else
+static const int SDF_SIMD_WIDTH = 4;
+#endif
+
+//------------------------------------------------------------------------------
+// Triangle vertices in SoA layout, padded with SDF_SIMD_WIDTH extra entries so a full width load
+// from any valid index stays inside the arrays.
+struct TriangleSoA
+{
+  void Resize(size_t numTriangles);
+  void Set(size_t idx, const vec3& a, const vec3& b, const vec3& c);
+
+  size_t size = 0;
+  vector<float> ax, ay, az;
+  vector<float> bx, by, bz;
+  vector<float> cx, cy, cz;
+};
+
+// Finds the closest point on up to SDF_SIMD_WIDTH triangles, starting at first, testing all of
+// them at once. Returns the offset of the closest triangle (the lowest one on ties, -1 if none
+// had a valid distance), and its squared distance, closest point and feature. The feature
+// classification matches ClosestPtvec3Triangle exactly.
+int ClosestPtTrianglesSimd(
+    const vec3& p,
+    const TriangleSoA& tris,
+    size_t first,
+    int count,
+    float* distSq,
+    vec3* pt,
+    TriangleFeature* feature);
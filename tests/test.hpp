@@ -0,0 +1,23 @@
+#pragma once
+
+static int g_NumChecks = 0;
+static int g_NumFailures = 0;
+
+// Records a failure and keeps going, so one run reports every broken check.
+#define CHECK(cond)                                                                                   \
+  do                                                                                                  \
+  {                                                                                                   \
+    ++g_NumChecks;                                                                                    \
+    if (!(cond))                                                                                      \
+    {                                                                                                 \
+      printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond);                                 \
+      ++g_NumFailures;                                                                                \
+    }                                                                                                 \
+  } while (false)
+
+//------------------------------------------------------------------------------
+inline int TestResult(const char* name)
+{
+  printf("%s: %d checks, %d failed\n", name, g_NumChecks, g_NumFailures);
+  return g_NumFailures ? 1 : 0;
+}
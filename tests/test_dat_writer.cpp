@@ -0,0 +1,171 @@
+#include "dat_writer.hpp"
+#include "exporter_utils.hpp"
+#include "test.hpp"
+
+// exporter_utils.cpp needs melange, so the hash is defined here. g_CollideHashes makes every hash the
+// same, to check that dedup compares the data and not just the hash
+static bool g_CollideHashes = false;
+
+//------------------------------------------------------------------------------
+u64 FnvHash64(const void* data, size_t len, u64 hash)
+{
+  if (g_CollideHashes)
+    return 1;
+
+  const u8* ptr = (const u8*)data;
+  for (size_t i = 0; i < len; ++i)
+  {
+    hash ^= ptr[i];
+    hash *= 0x100000001b3ull;
+  }
+  return hash;
+}
+
+namespace
+{
+  const char* FILENAME = "build/test_dat_writer.dat";
+
+  //------------------------------------------------------------------------------
+  vector<char> ReadFile(const char* filename)
+  {
+    vector<char> buf;
+    FILE* f = fopen(filename, "rb");
+    if (!f)
+      return buf;
+    fseek(f, 0, SEEK_END);
+    buf.resize(ftell(f));
+    fseek(f, 0, SEEK_SET);
+    if (!buf.empty() && fread(buf.data(), buf.size(), 1, f) != 1)
+      buf.clear();
+    fclose(f);
+    return buf;
+  }
+
+  //------------------------------------------------------------------------------
+  vector<char> Pattern(size_t len, int seed)
+  {
+    vector<char> data(len);
+    for (size_t i = 0; i < len; ++i)
+      data[i] = (char)(i * 31 + seed);
+    return data;
+  }
+
+  //------------------------------------------------------------------------------
+  struct Added
+  {
+    vector<char> data;
+    DatSectionType type;
+    int idx;
+    bool deduped;
+  };
+
+  //------------------------------------------------------------------------------
+  // Adds the sections in order, and then checks the file written against them: the header, the
+  // section table, the alignment of every section, and its data
+  bool WriteAndCheck(vector<Added>* added, int expectedSections)
+  {
+    DatWriter writer;
+    if (!writer.Open(FILENAME))
+      return false;
+    for (Added& a : *added)
+      a.idx = writer.AddSection(a.data.data(), a.data.size(), a.type, &a.deduped);
+    u64 size = writer.Size();
+    if (!writer.Close())
+      return false;
+
+    vector<char> file = ReadFile(FILENAME);
+    if (file.size() < sizeof(DatHeader))
+      return false;
+    DatHeader header;
+    memcpy(&header, file.data(), sizeof(header));
+    bool ok = header.magic == DAT_MAGIC && header.version == DAT_VERSION
+              && header.numSections == (u32)expectedSections && header.fileSize == file.size()
+              && header.sectionTableOffset % 16 == 0 && header.sectionTableOffset >= size
+              && header.sectionTableOffset + header.numSections * sizeof(DatSection) == file.size();
+    if (!ok)
+      return false;
+
+    vector<DatSection> sections(header.numSections);
+    if (!sections.empty())
+      memcpy(sections.data(), &file[header.sectionTableOffset], sections.size() * sizeof(DatSection));
+
+    for (const Added& a : *added)
+    {
+      if (a.idx < 0 || a.idx >= (int)sections.size())
+        return false;
+      const DatSection& s = sections[a.idx];
+      ok &= s.type == a.type && s.alignment == DatSectionAlignment(a.type) && s.offset % s.alignment == 0
+            && s.size == a.data.size() && s.offset >= sizeof(DatHeader)
+            && s.offset + s.size <= header.sectionTableOffset
+            && memcmp(&file[s.offset], a.data.data(), a.data.size()) == 0;
+    }
+    return ok;
+  }
+}
+
+//------------------------------------------------------------------------------
+static void TestEmpty()
+{
+  vector<Added> added;
+  CHECK(WriteAndCheck(&added, 0));
+  CHECK(ReadFile(FILENAME).size() == sizeof(DatHeader));
+}
+
+//------------------------------------------------------------------------------
+static void TestSectionsAndDedup()
+{
+  vector<char> a = Pattern(1000, 1);
+  vector<char> b = a;
+  b[500] ^= 1;
+
+  vector<Added> added = {
+      {a, DatSectionType::MeshStream},
+      // odd sizes, so the next section needs padding
+      {Pattern(3, 2), DatSectionType::AnimTrack},
+      {a, DatSectionType::MeshStream},
+      // the same data as another type is its own section
+      {a, DatSectionType::Generic},
+      // one byte changed
+      {b, DatSectionType::MeshStream},
+      // larger than the compare chunk, and repeated
+      {Pattern(200 * 1024 + 5, 3), DatSectionType::Sdf},
+      {Pattern(200 * 1024 + 5, 3), DatSectionType::Sdf},
+      {vector<char>(), DatSectionType::Generic},
+  };
+  CHECK(WriteAndCheck(&added, 6));
+
+  CHECK(!added[0].deduped && !added[1].deduped && !added[3].deduped && !added[4].deduped);
+  CHECK(added[2].deduped && added[2].idx == added[0].idx);
+  CHECK(added[6].deduped && added[6].idx == added[5].idx);
+  CHECK(added[3].idx != added[0].idx && added[4].idx != added[0].idx);
+}
+
+//------------------------------------------------------------------------------
+static void TestHashCollisions()
+{
+  // every section has the same hash, so only the data compare tells them apart
+  g_CollideHashes = true;
+  vector<char> a = Pattern(100 * 1024, 4);
+  vector<char> b = a;
+  b.back() ^= 1;
+  vector<Added> added = {
+      {a, DatSectionType::MeshStream},
+      {b, DatSectionType::MeshStream},
+      {a, DatSectionType::MeshStream},
+      {b, DatSectionType::MeshStream},
+  };
+  CHECK(WriteAndCheck(&added, 2));
+  CHECK(added[2].deduped && added[2].idx == added[0].idx);
+  CHECK(added[3].deduped && added[3].idx == added[1].idx);
+  g_CollideHashes = false;
+}
+
+//------------------------------------------------------------------------------
+int main()
+{
+  TestEmpty();
+  TestSectionsAndDedup();
+  TestHashCollisions();
+  remove(FILENAME);
+  return TestResult("test_dat_writer");
+}
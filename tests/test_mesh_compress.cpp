@@ -0,0 +1,107 @@
+#include "mesh_compress.hpp"
+#include "compress/indexbuffercompressionformat.h"
+#include "test.hpp"
+#include <random>
+
+namespace
+{
+  //------------------------------------------------------------------------------
+  // Compresses and decompresses the triangles, and checks that the decompressed triangles are the
+  // input triangles after the vertex remap, up to rotation
+  bool RoundTrip(const vector<u32>& indices, int vertexCount, size_t* compressedSize = nullptr)
+  {
+    vector<char> data;
+    vector<u32> remap;
+    CompressIndices(indices, vertexCount, &data, &remap);
+    if (compressedSize)
+      *compressedSize = data.size();
+
+    // every used vertex gets a unique new index below vertexCount
+    std::set<u32> used(indices.begin(), indices.end());
+    std::set<u32> newIndices;
+    for (u32 idx : used)
+    {
+      if (remap[idx] >= (u32)vertexCount || !newIndices.insert(remap[idx]).second)
+        return false;
+    }
+
+    // IBCF_AUTO records the format it picked
+    int format = CompressedIndexFormat(data);
+    return (format == IBCF_PER_INDICE_1 || format == IBCF_PER_TRIANGLE_1)
+           && VerifyCompressedIndices(indices, remap, data);
+  }
+
+  //------------------------------------------------------------------------------
+  // A w x h grid of quads, split into two triangles each, so neighbouring triangles share edges
+  vector<u32> Grid(int w, int h)
+  {
+    vector<u32> indices;
+    for (int y = 0; y < h; ++y)
+    {
+      for (int x = 0; x < w; ++x)
+      {
+        u32 i0 = y * (w + 1) + x, i1 = i0 + 1, i2 = i0 + w + 1, i3 = i2 + 1;
+        indices.insert(indices.end(), {i0, i1, i2, i2, i1, i3});
+      }
+    }
+    return indices;
+  }
+}
+
+//------------------------------------------------------------------------------
+static void TestSmall()
+{
+  CHECK(RoundTrip({}, 0));
+  CHECK(RoundTrip({0, 1, 2}, 3));
+  CHECK(RoundTrip({2, 0, 1}, 3));
+  // the same triangle twice, and a triangle using a vertex that isn't the first one
+  CHECK(RoundTrip({0, 1, 2, 0, 1, 2}, 3));
+  CHECK(RoundTrip({5, 3, 4}, 6));
+}
+
+//------------------------------------------------------------------------------
+static void TestDegenerate()
+{
+  // triangles with repeated corners, mixed with regular ones
+  CHECK(RoundTrip({0, 0, 1}, 2));
+  CHECK(RoundTrip({0, 0, 0}, 1));
+  CHECK(RoundTrip({0, 1, 2, 2, 2, 3, 1, 3, 3, 0, 1, 2, 4, 4, 4}, 5));
+}
+
+//------------------------------------------------------------------------------
+static void TestEdgeReuse()
+{
+  // every triangle after the first shares an edge with an earlier one, so most of them should come
+  // from the edge cache and cost a lot less than a 16 bit index buffer
+  vector<u32> indices = Grid(32, 32);
+  size_t compressedSize;
+  CHECK(RoundTrip(indices, 33 * 33, &compressedSize));
+  CHECK(compressedSize * 4 < indices.size() * sizeof(u16));
+}
+
+//------------------------------------------------------------------------------
+static void TestIndexWidth()
+{
+  // random triangle soups below and above the 16 bit index range
+  std::mt19937 rng(7);
+  for (int vertexCount : {100, 65535, 65536, 200000})
+  {
+    vector<u32> indices(3 * 5000);
+    for (u32& idx : indices)
+      idx = rng() % vertexCount;
+    CHECK(RoundTrip(indices, vertexCount));
+  }
+
+  // a grid that needs 32 bit indices
+  CHECK(RoundTrip(Grid(400, 200), 401 * 201));
+}
+
+//------------------------------------------------------------------------------
+int main()
+{
+  TestSmall();
+  TestDegenerate();
+  TestEdgeReuse();
+  TestIndexWidth();
+  return TestResult("test_mesh_compress");
+}
@@ -0,0 +1,206 @@
+#include "mesh_simplify.hpp"
+#include "test.hpp"
+#include <random>
+
+namespace
+{
+  //------------------------------------------------------------------------------
+  // A closed, bumpy sphere made of a latitude/longitude grid, with single vertices at the poles
+  void Sphere(int rings, int segments, std::mt19937* rng, vector<vec3>* pos, vector<u32>* indices)
+  {
+    std::uniform_real_distribution<float> u(0.95f, 1.05f);
+    pos->push_back(vec3(0, 1, 0));
+    for (int r = 1; r < rings; ++r)
+    {
+      float theta = 3.14159265f * r / rings;
+      for (int s = 0; s < segments; ++s)
+      {
+        float phi = 2 * 3.14159265f * s / segments;
+        float radius = u(*rng);
+        pos->push_back(
+            vec3(radius * sinf(theta) * cosf(phi), radius * cosf(theta), radius * sinf(theta) * sinf(phi)));
+      }
+    }
+    pos->push_back(vec3(0, -1, 0));
+
+    u32 bottom = (u32)pos->size() - 1;
+    auto fnVtx = [&](int r, int s) { return (u32)(1 + (r - 1) * segments + s % segments); };
+    for (int s = 0; s < segments; ++s)
+    {
+      indices->insert(indices->end(), {0, fnVtx(1, s + 1), fnVtx(1, s)});
+      indices->insert(indices->end(), {bottom, fnVtx(rings - 1, s), fnVtx(rings - 1, s + 1)});
+      for (int r = 1; r < rings - 1; ++r)
+      {
+        u32 a = fnVtx(r, s), b = fnVtx(r, s + 1), c = fnVtx(r + 1, s), d = fnVtx(r + 1, s + 1);
+        indices->insert(indices->end(), {a, b, c, c, b, d});
+      }
+    }
+  }
+
+  //------------------------------------------------------------------------------
+  // A w x h heightfield grid in the xy plane, with bumps in z so the quadrics aren't all zero
+  void Grid(int w, int h, std::mt19937* rng, vector<vec3>* pos, vector<u32>* indices)
+  {
+    std::uniform_real_distribution<float> u(-0.05f, 0.05f);
+    for (int y = 0; y <= h; ++y)
+    {
+      for (int x = 0; x <= w; ++x)
+        pos->push_back(vec3((float)x, (float)y, 0.5f * sinf(x * 0.4f) * cosf(y * 0.3f) + u(*rng)));
+    }
+
+    for (int y = 0; y < h; ++y)
+    {
+      for (int x = 0; x < w; ++x)
+      {
+        u32 i0 = y * (w + 1) + x, i1 = i0 + 1, i2 = i0 + w + 1, i3 = i2 + 1;
+        indices->insert(indices->end(), {i0, i1, i2, i2, i1, i3});
+      }
+    }
+  }
+
+  //------------------------------------------------------------------------------
+  // Every index is in range, and no triangle is degenerate
+  bool ValidIndices(const vector<vec3>& pos, const vector<u32>& indices)
+  {
+    if (indices.size() % 3 != 0)
+      return false;
+    for (size_t i = 0; i < indices.size(); i += 3)
+    {
+      u32 a = indices[i], b = indices[i + 1], c = indices[i + 2];
+      if (a >= pos.size() || b >= pos.size() || c >= pos.size() || a == b || a == c || b == c)
+        return false;
+    }
+    return true;
+  }
+
+  //------------------------------------------------------------------------------
+  // Every directed edge is used once, so the triangles are consistently wound and nothing folded over
+  // onto an existing triangle
+  bool UniqueDirectedEdges(const vector<u32>& indices)
+  {
+    vector<u64> edges;
+    for (size_t i = 0; i < indices.size(); i += 3)
+    {
+      for (int j = 0; j < 3; ++j)
+        edges.push_back(((u64)indices[i + j] << 32) | indices[i + (j + 1) % 3]);
+    }
+    sort(edges.begin(), edges.end());
+    return adjacent_find(edges.begin(), edges.end()) == edges.end();
+  }
+
+  //------------------------------------------------------------------------------
+  // Number of triangles that face down, ie flipped triangles in a heightfield
+  int NumFlipped(const vector<vec3>& pos, const vector<u32>& indices)
+  {
+    int numFlipped = 0;
+    for (size_t i = 0; i < indices.size(); i += 3)
+    {
+      const vec3& a = pos[indices[i]];
+      numFlipped += Cross(pos[indices[i + 1]] - a, pos[indices[i + 2]] - a).z <= 0;
+    }
+    return numFlipped;
+  }
+
+  //------------------------------------------------------------------------------
+  // Sorted (min, max) pairs of the edges that are only used by one triangle
+  vector<u64> BorderEdges(const vector<u32>& indices)
+  {
+    vector<u64> edges;
+    for (size_t i = 0; i < indices.size(); i += 3)
+    {
+      for (int j = 0; j < 3; ++j)
+      {
+        u32 a = indices[i + j], b = indices[i + (j + 1) % 3];
+        edges.push_back(((u64)min(a, b) << 32) | max(a, b));
+      }
+    }
+    sort(edges.begin(), edges.end());
+
+    vector<u64> border;
+    for (size_t i = 0; i < edges.size();)
+    {
+      size_t j = i;
+      while (j < edges.size() && edges[j] == edges[i])
+        ++j;
+      if (j - i == 1)
+        border.push_back(edges[i]);
+      i = j;
+    }
+    return border;
+  }
+}
+
+//------------------------------------------------------------------------------
+static void TestClosedMesh()
+{
+  std::mt19937 rng(3);
+  vector<vec3> pos;
+  vector<u32> indices;
+  Sphere(40, 60, &rng, &pos, &indices);
+
+  // halving the triangle count, like each exported lod does, and then going much further
+  for (int target : {(int)indices.size() / 2, (int)indices.size() / 8})
+  {
+    target = target / 3 * 3;
+    vector<u32> out;
+    float error = SimplifyIndices(pos, indices.data(), (int)indices.size(), target, &out);
+    CHECK(out.size() <= (size_t)target);
+    CHECK(out.size() >= (size_t)target * 3 / 4);
+    CHECK(ValidIndices(pos, out));
+    // still closed, so no border edges
+    CHECK(BorderEdges(out).empty());
+    CHECK(UniqueDirectedEdges(out));
+    // the bumps are 5% of the radius
+    CHECK(error > 0 && error < 0.1f);
+  }
+}
+
+//------------------------------------------------------------------------------
+static void TestHeightfield()
+{
+  std::mt19937 rng(5);
+  vector<vec3> pos;
+  vector<u32> indices;
+  Grid(30, 20, &rng, &pos, &indices);
+
+  // simplified a lot, so triangles get turned in several passes, and every one still has to face up
+  vector<u32> out;
+  SimplifyIndices(pos, indices.data(), (int)indices.size(), (int)indices.size() / 4 / 3 * 3, &out);
+  CHECK(out.size() < indices.size() / 2);
+  CHECK(ValidIndices(pos, out));
+  CHECK(UniqueDirectedEdges(out));
+  CHECK(NumFlipped(pos, indices) == 0);
+  CHECK(NumFlipped(pos, out) == 0);
+  // border vertices never move, so the border is kept edge for edge
+  CHECK(BorderEdges(out) == BorderEdges(indices));
+}
+
+//------------------------------------------------------------------------------
+static void TestNothingToDo()
+{
+  std::mt19937 rng(9);
+  vector<vec3> pos;
+  vector<u32> indices;
+  Grid(4, 4, &rng, &pos, &indices);
+
+  // already at the target
+  vector<u32> out;
+  float error = SimplifyIndices(pos, indices.data(), (int)indices.size(), (int)indices.size(), &out);
+  CHECK(out == indices);
+  CHECK(error == 0);
+
+  // a single triangle only has border vertices, so nothing can collapse
+  vector<u32> tri = {0, 1, 5};
+  error = SimplifyIndices(pos, tri.data(), 3, 0, &out);
+  CHECK(out == tri);
+  CHECK(error == 0);
+}
+
+//------------------------------------------------------------------------------
+int main()
+{
+  TestClosedMesh();
+  TestHeightfield();
+  TestNothingToDo();
+  return TestResult("test_mesh_simplify");
+}
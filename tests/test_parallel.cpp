@@ -0,0 +1,109 @@
+#include "parallel.hpp"
+#include "test.hpp"
+
+//------------------------------------------------------------------------------
+static bool VisitsEveryItemOnce(int numItems, int numThreads)
+{
+  vector<std::atomic<int>> visits(numItems);
+  for (std::atomic<int>& v : visits)
+    v = 0;
+
+  ParallelFor(numItems, numThreads, [&](int idx) { visits[idx]++; });
+
+  for (const std::atomic<int>& v : visits)
+  {
+    if (v != 1)
+      return false;
+  }
+  return true;
+}
+
+//------------------------------------------------------------------------------
+static void TestEveryItemOnce()
+{
+  for (int numItems : {0, 1, 2, 7, 100, 10000})
+  {
+    for (int numThreads : {1, 2, 3, 8, 64})
+      CHECK(VisitsEveryItemOnce(numItems, numThreads));
+  }
+}
+
+//------------------------------------------------------------------------------
+static void TestPoolReuse()
+{
+  // many small calls, with the thread count going up and down, so the pool is reused, grown and
+  // partially idle
+  bool ok = true;
+  for (int i = 0; i < 2000 && ok; ++i)
+    ok = VisitsEveryItemOnce(1 + i % 37, 2 + i % 7);
+  CHECK(ok);
+}
+
+//------------------------------------------------------------------------------
+static void TestStealing()
+{
+  // all the work is in the first thread's range, so the others only get items by stealing
+  int numItems = 256;
+  vector<std::atomic<int>> visits(numItems);
+  for (std::atomic<int>& v : visits)
+    v = 0;
+
+  std::atomic<int> sum(0);
+  ParallelFor(numItems, 4, [&](int idx) {
+    visits[idx]++;
+    if (idx < numItems / 4)
+    {
+      volatile int x = 0;
+      for (int i = 0; i < 20000; ++i)
+        x = x + i;
+    }
+    sum += idx;
+  });
+
+  bool once = true;
+  for (const std::atomic<int>& v : visits)
+    once &= v == 1;
+  CHECK(once);
+  CHECK(sum == numItems * (numItems - 1) / 2);
+}
+
+//------------------------------------------------------------------------------
+static void TestConcurrentCallers()
+{
+  // every calling thread has its own pool, like the --jobs workers
+  std::atomic<int> numFailed(0);
+  vector<std::thread> callers;
+  for (int i = 0; i < 4; ++i)
+  {
+    callers.push_back(std::thread([&, i]() {
+      for (int j = 0; j < 200; ++j)
+      {
+        if (!VisitsEveryItemOnce(50 + j, 1 + (i + j) % 4))
+          numFailed++;
+      }
+    }));
+  }
+
+  for (std::thread& t : callers)
+    t.join();
+  CHECK(numFailed == 0);
+}
+
+//------------------------------------------------------------------------------
+static void TestNumWorkerThreads()
+{
+  CHECK(NumWorkerThreads(3) == 3);
+  CHECK(NumWorkerThreads(0) >= 1);
+  CHECK(NumWorkerThreads(-1) >= 1);
+}
+
+//------------------------------------------------------------------------------
+int main()
+{
+  TestEveryItemOnce();
+  TestPoolReuse();
+  TestStealing();
+  TestConcurrentCallers();
+  TestNumWorkerThreads();
+  return TestResult("test_parallel");
+}
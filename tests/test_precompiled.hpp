@@ -0,0 +1,86 @@
+#pragma once
+
+// Stand-in for precompiled.hpp when building the tests without melange and windows.h. It has the
+// same std includes and typedefs, and just enough of melange for the scene headers to parse.
+
+#include <stdio.h>
+#include <assert.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+#include <time.h>
+
+#include <vector>
+#include <deque>
+#include <string>
+#include <unordered_map>
+#include <set>
+#include <map>
+#include <algorithm>
+#include <unordered_set>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <thread>
+#include <atomic>
+#include <mutex>
+
+#include <xmmintrin.h>
+#include <pmmintrin.h>
+
+namespace melange
+{
+  struct Vector
+  {
+    double x, y, z;
+  };
+
+  struct Matrix
+  {
+    Vector off, v1, v2, v3;
+  };
+
+  struct GeData
+  {
+    Vector GetVector() const;
+    double GetFloat() const;
+    int GetInt32() const;
+  };
+
+  class String;
+  class BaseList2D;
+  class BaseObject {};
+  class SplineObject : public BaseObject {};
+  class BaseShader;
+  class BaseMaterial;
+  class AlienBaseDocument;
+}
+
+typedef uint8_t u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef uint64_t u64;
+
+typedef int8_t s8;
+typedef int16_t s16;
+typedef int32_t s32;
+typedef int64_t s64;
+
+using std::vector;
+using std::string;
+using std::wstring;
+using std::pair;
+using std::make_pair;
+using std::hash;
+using std::min;
+using std::max;
+using std::unordered_map;
+using std::unordered_set;
+using std::function;
+using std::initializer_list;
+using std::map;
+using std::deque;
+using std::shared_ptr;
+using std::unique_ptr;
+using std::make_unique;
@@ -0,0 +1,102 @@
+#include "sdf_bvh.hpp"
+#include "test.hpp"
+#include <random>
+
+// im_scene.cpp needs melange, and the meshes here don't have a melange object
+ImBaseObject::ImBaseObject(melange::BaseObject* melangeObj) : melangeObj(melangeObj) {}
+
+//------------------------------------------------------------------------------
+static ImMesh* RandomMesh(int numVerts, int numFaces, std::mt19937* rng)
+{
+  std::uniform_real_distribution<float> u(-1, 1);
+  ImMesh* mesh = new ImMesh(nullptr);
+  for (int i = 0; i < numVerts; ++i)
+    mesh->geometry.vertices.push_back(ImMeshVertex{u(*rng), u(*rng), u(*rng)});
+
+  // random corners, so some faces share corners and are degenerate
+  for (int i = 0; i < numFaces; ++i)
+  {
+    ImMeshFace face;
+    face.a = (*rng)() % numVerts;
+    face.b = (*rng)() % numVerts;
+    face.c = (*rng)() % numVerts;
+    mesh->geometry.faces.push_back(face);
+  }
+  return mesh;
+}
+
+//------------------------------------------------------------------------------
+static TriangleBvh::ClosestHit LinearScan(const vector<ImMesh*>& meshes, const vec3& p)
+{
+  // meshes and faces in order, with a strict compare, so ties go to the first triangle
+  TriangleBvh::ClosestHit best;
+  for (u32 meshIdx = 0; meshIdx < (u32)meshes.size(); ++meshIdx)
+  {
+    const ImGeometry& g = meshes[meshIdx]->geometry;
+    for (u32 faceIdx = 0; faceIdx < (u32)g.faces.size(); ++faceIdx)
+    {
+      const ImMeshFace& f = g.faces[faceIdx];
+      TriangleFeature feature;
+      vec3 pt = ClosestPtvec3Triangle(p, g.vertices[f.a], g.vertices[f.b], g.vertices[f.c], &feature);
+      float distSq = LengthSq(pt - p);
+      if (distSq < best.distSq)
+      {
+        best.distSq = distSq;
+        best.pt = pt;
+        best.feature = feature;
+        best.meshIdx = meshIdx;
+        best.faceIdx = faceIdx;
+      }
+    }
+  }
+  return best;
+}
+
+//------------------------------------------------------------------------------
+static void TestMatchesLinearScan()
+{
+  std::mt19937 rng(42);
+  vector<ImMesh*> meshes;
+  for (int i = 0; i < 3; ++i)
+    meshes.push_back(RandomMesh(300, 500, &rng));
+  // a second copy of the first mesh, so every closest triangle has an exact tie to break
+  meshes.push_back(new ImMesh(nullptr));
+  meshes.back()->geometry = meshes[0]->geometry;
+
+  TriangleBvh bvh;
+  bvh.Build(meshes);
+  CHECK(bvh.triangles.size() == 2000);
+
+  std::uniform_real_distribution<float> u(-2, 2);
+  int numMismatches = 0;
+  for (int q = 0; q < 2000; ++q)
+  {
+    vec3 p(u(rng), u(rng), u(rng));
+    TriangleBvh::ClosestHit expected = LinearScan(meshes, p);
+    TriangleBvh::ClosestHit hit;
+    bool found = bvh.ClosestTriangle(p, &hit);
+    numMismatches += !found || hit.distSq != expected.distSq || hit.meshIdx != expected.meshIdx
+                     || hit.faceIdx != expected.faceIdx || hit.feature != expected.feature;
+  }
+  CHECK(numMismatches == 0);
+
+  for (ImMesh* mesh : meshes)
+    delete mesh;
+}
+
+//------------------------------------------------------------------------------
+static void TestEmpty()
+{
+  TriangleBvh bvh;
+  bvh.Build(vector<ImMesh*>());
+  TriangleBvh::ClosestHit hit;
+  CHECK(!bvh.ClosestTriangle(vec3(0, 0, 0), &hit));
+}
+
+//------------------------------------------------------------------------------
+int main()
+{
+  TestMatchesLinearScan();
+  TestEmpty();
+  return TestResult("test_sdf_bvh");
+}
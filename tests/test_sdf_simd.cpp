@@ -0,0 +1,166 @@
+#include "sdf_simd.hpp"
+#include "test.hpp"
+#include <random>
+
+namespace
+{
+  struct Tri
+  {
+    vec3 a, b, c;
+  };
+
+  //------------------------------------------------------------------------------
+  bool SameBits(float lhs, float rhs)
+  {
+    return memcmp(&lhs, &rhs, sizeof(float)) == 0;
+  }
+
+  //------------------------------------------------------------------------------
+  bool SameBits(const vec3& lhs, const vec3& rhs)
+  {
+    return SameBits(lhs.x, rhs.x) && SameBits(lhs.y, rhs.y) && SameBits(lhs.z, rhs.z);
+  }
+
+  //------------------------------------------------------------------------------
+  vector<Tri> MakeTriangles(std::mt19937* rng)
+  {
+    std::uniform_real_distribution<float> u(-1, 1);
+    auto fnPoint = [&]() { return vec3(u(*rng), u(*rng), u(*rng)); };
+
+    vector<Tri> tris;
+    for (int i = 0; i < 2000; ++i)
+      tris.push_back(Tri{fnPoint(), fnPoint(), fnPoint()});
+
+    // degenerate triangles: two shared corners, three shared corners, and collinear corners
+    for (int i = 0; i < 100; ++i)
+    {
+      vec3 a = fnPoint();
+      vec3 b = fnPoint();
+      tris.push_back(Tri{a, a, b});
+      tris.push_back(Tri{a, b, b});
+      tris.push_back(Tri{a, a, a});
+      tris.push_back(Tri{a, b, a + (b - a) * 0.5f});
+    }
+
+    std::shuffle(tris.begin(), tris.end(), *rng);
+    return tris;
+  }
+
+  //------------------------------------------------------------------------------
+  vec3 QueryPoint(const vector<Tri>& tris, size_t first, std::mt19937* rng)
+  {
+    // mix points far from the triangles with points close to their corners and edges, so every
+    // feature region gets hit
+    std::uniform_real_distribution<float> u(-1, 1);
+    const Tri& t = tris[first];
+    vec3 jitter(u(*rng) * 0.05f, u(*rng) * 0.05f, u(*rng) * 0.05f);
+    switch ((*rng)() % 4)
+    {
+      case 0: return vec3(u(*rng) * 2, u(*rng) * 2, u(*rng) * 2);
+      case 1: return t.a + jitter;
+      case 2: return t.b + (t.c - t.b) * 0.5f + jitter;
+      default: return (t.a + t.b + t.c) / 3 + jitter;
+    }
+  }
+}
+
+//------------------------------------------------------------------------------
+static void TestSingleLane(const vector<Tri>& tris, const TriangleSoA& soa, std::mt19937* rng)
+{
+  // every triangle on its own, to check the feature classification lane by lane
+  int numMismatches = 0;
+  std::set<int> featuresSeen;
+  for (size_t i = 0; i < tris.size(); ++i)
+  {
+    for (int j = 0; j < 4; ++j)
+    {
+      vec3 p = QueryPoint(tris, i, rng);
+      const Tri& t = tris[i];
+
+      TriangleFeature feature;
+      vec3 pt = ClosestPtvec3Triangle(p, t.a, t.b, t.c, &feature);
+      float distSq = LengthSq(pt - p);
+
+      float simdDistSq;
+      vec3 simdPt;
+      TriangleFeature simdFeature;
+      int ofs = ClosestPtTrianglesSimd(p, soa, i, 1, &simdDistSq, &simdPt, &simdFeature);
+
+      // degenerate triangles can give a NaN distance, which the kernel never picks
+      bool valid = distSq < FLT_MAX;
+      bool match = valid ? ofs == 0 && simdFeature == feature && SameBits(simdDistSq, distSq)
+                               && SameBits(simdPt, pt)
+                         : ofs == -1;
+      numMismatches += !match;
+      if (valid)
+        featuresSeen.insert(feature);
+    }
+  }
+
+  CHECK(numMismatches == 0);
+  // all three vertices, all three edges, and the face
+  CHECK(featuresSeen.size() == 7);
+}
+
+//------------------------------------------------------------------------------
+static void TestLeaves(const vector<Tri>& tris, const TriangleSoA& soa, std::mt19937* rng)
+{
+  // partial and full leaves anywhere in the list, including the last SDF_SIMD_WIDTH triangles, where
+  // the unused lanes read the padding
+  int numMismatches = 0;
+  for (int q = 0; q < 20000; ++q)
+  {
+    int count = 1 + (int)((*rng)() % SDF_SIMD_WIDTH);
+    size_t first = q % 10 == 0 ? tris.size() - count : (*rng)() % (tris.size() - count + 1);
+    vec3 p = QueryPoint(tris, first, rng);
+
+    // the lowest offset wins ties, and NaN distances never win
+    int best = -1;
+    float bestDistSq = FLT_MAX;
+    vec3 bestPt;
+    TriangleFeature bestFeature = FeatureFace;
+    for (int i = 0; i < count; ++i)
+    {
+      const Tri& t = tris[first + i];
+      TriangleFeature feature;
+      vec3 pt = ClosestPtvec3Triangle(p, t.a, t.b, t.c, &feature);
+      float distSq = LengthSq(pt - p);
+      if (distSq < bestDistSq)
+      {
+        best = i;
+        bestDistSq = distSq;
+        bestPt = pt;
+        bestFeature = feature;
+      }
+    }
+
+    float distSq;
+    vec3 pt;
+    TriangleFeature feature;
+    int ofs = ClosestPtTrianglesSimd(p, soa, first, count, &distSq, &pt, &feature);
+
+    bool match = ofs == best
+                 && (best == -1
+                     || (feature == bestFeature && SameBits(distSq, bestDistSq) && SameBits(pt, bestPt)));
+    numMismatches += !match;
+  }
+
+  CHECK(numMismatches == 0);
+}
+
+//------------------------------------------------------------------------------
+int main()
+{
+  std::mt19937 rng(1234);
+  vector<Tri> tris = MakeTriangles(&rng);
+
+  TriangleSoA soa;
+  soa.Resize(tris.size());
+  for (size_t i = 0; i < tris.size(); ++i)
+    soa.Set(i, tris[i].a, tris[i].b, tris[i].c);
+
+  TestSingleLane(tris, soa, &rng);
+  TestLeaves(tris, soa, &rng);
+  printf("simd width: %d\n", SDF_SIMD_WIDTH);
+  return TestResult("test_sdf_simd");
+}